@@ -2,6 +2,7 @@
 #include <fstream>
 #include <iostream>
 #include <algorithm>
+#include <array>
 #include <cstring>
 #include <unordered_set>
 
@@ -12,31 +13,13 @@
 
 namespace fs = std::filesystem;
 
-bool read_string(const unsigned char* buf, size_t buf_len, size_t& pos, std::string& out)
-{
-    if (pos >= buf_len)
-        return false;
-
-    size_t start = pos;
-    while (pos < buf_len && buf[pos] != '\0')
-        pos++;
-
-    if (pos >= buf_len)
-        return false;
-
-    out = std::string(reinterpret_cast<const char*>(buf + start), pos - start);
-    pos++;
-
-    return true;
-}
-
-std::unordered_set<std::string> g_emitted_localize_prefixes;
-
 void ensure_parent_dirs(const fs::path& filepath)
 {
     fs::path parent = filepath.parent_path();
+    // writer threads may race to create the same directory; real failures surface when the file is opened
+    std::error_code ec;
     if (!parent.empty())
-        fs::create_directories(parent);
+        fs::create_directories(parent, ec);
 }
 
 std::string trim_and_lower(std::string s)
@@ -74,48 +57,122 @@ std::string sanitize_for_print(const std::string& s)
     return out;
 }
 
-std::shared_ptr<Asset> assets;
-AssetHandler asset_handlers[static_cast<int>(XAssetType::ASSETLIST)];
-
-std::shared_ptr<Asset> new_xasset(XAssetType type, const std::string& name, const std::string& filename)
+Asset* new_xasset(LinkContext& ctx, XAssetType type, const std::string& name, const std::string& filename)
 {
-    auto asset = std::make_shared<Asset>();
+    auto asset = std::make_unique<Asset>();
     asset->type = type;
     asset->filename = filename;
     asset->name = name;
-    asset->header = std::make_unique<XAssetHeader>();
-    asset->next = nullptr;
 
-    if (!assets)
+    ctx.assets.push_back(std::move(asset));
+    return ctx.assets.back().get();
+}
+
+char* LinkContext::alloc_bytes(size_t len)
+{
+    const size_t block_size = 64 * 1024;
+
+    // big requests get a block of their own so the current one keeps filling
+    if (len > block_size / 4)
     {
-        assets = asset;
+        blocks.emplace_back(new char[len]);
+        return blocks.back().get();
     }
-    else
+
+    if (len > block_remaining)
     {
-        auto current = assets;
-        while (current->next)
-            current = current->next;
-        current->next = asset;
+        blocks.emplace_back(new char[block_size]);
+        block_cursor = blocks.back().get();
+        block_remaining = block_size;
     }
 
-    return asset;
+    char* p = block_cursor;
+    block_cursor += len;
+    block_remaining -= len;
+    return p;
 }
 
-int asset_count()
+const char* LinkContext::copy_string(std::string_view str)
 {
-    int count = 0;
-    auto current = assets;
-    while (current)
+    char* p = alloc_bytes(str.size() + 1);
+    std::memcpy(p, str.data(), str.size());
+    p[str.size()] = '\0';
+    return p;
+}
+
+std::uint32_t pool_string(LinkContext& ctx, std::string_view str, std::uint32_t& next)
+{
+    const std::uint32_t offset_mask = 0x0FFFFFFF;
+
+    if (ctx.options.pool_strings)
     {
-        count++;
-        current = current->next;
+        auto found = ctx.string_pool.find(str);
+        if (found != ctx.string_pool.end())
+            return found->second;
+
+        // zone pointers only hold a 28-bit block offset; str may not outlive this call, so the key is a copy
+        if (((next - 1) & offset_mask) + str.size() < offset_mask)
+            ctx.string_pool.emplace(std::string_view(ctx.copy_string(str), str.size()), next);
     }
-    return count;
+
+    next += static_cast<std::uint32_t>(str.size() + 1);
+    return 0xFFFFFFFF;
 }
 
-extern void init_asset_handlers_impl();
+void UnlinkContext::begin_block(size_t pos)
+{
+    segments.assign(1, BlockSegment{0, pos});
+}
 
-void init_asset_handlers()
+void UnlinkContext::align_block(size_t pos, size_t alignment)
 {
-    init_asset_handlers_impl();
+    if (segments.empty())
+        return;
+
+    size_t offset = segments.back().offset + (pos - segments.back().pos);
+    size_t aligned = (offset + alignment - 1) & ~(alignment - 1);
+    if (aligned != offset)
+        segments.push_back({aligned, pos});
+}
+
+bool UnlinkContext::resolve_pointer(std::uint32_t ptr, size_t& pos) const
+{
+    if (ptr == 0 || segments.empty() || static_cast<int>((ptr - 1) >> 28) != XFILE_BLOCK_LARGE)
+        return false;
+
+    size_t offset = (ptr - 1) & 0x0FFFFFFF;
+    auto it = std::upper_bound(segments.begin(), segments.end(), offset,
+                               [](size_t off, const BlockSegment& seg) { return off < seg.offset; });
+    if (it == segments.begin())
+        return false;
+    --it;
+
+    pos = it->pos + (offset - it->offset);
+    return true;
+}
+
+bool UnlinkContext::read_string(const binary_io::ByteSpan& zone, size_t& pos, std::uint32_t ptr, std::string_view& out) const
+{
+    if (ptr == 0xFFFFFFFF)
+        return zone.read_string(pos, out);
+
+    size_t at = 0;
+    return resolve_pointer(ptr, at) && at < pos && zone.read_string(at, out);
+}
+
+const AssetHandler* find_asset_handler(XAssetType type)
+{
+    static const auto table = []()
+    {
+        std::array<AssetHandler, static_cast<size_t>(XAssetType::ASSETLIST)> handlers = {};
+        handlers[static_cast<int>(XAssetType::LOCALIZE_ENTRY)] = {load_localize_entry, serialize_localize_entry, extract_localize_entry};
+        handlers[static_cast<int>(XAssetType::RAWFILE)] = {load_raw_file, serialize_raw_file, extract_raw_file};
+        handlers[static_cast<int>(XAssetType::STRINGTABLE)] = {load_string_table, serialize_string_table, extract_string_table};
+        return handlers;
+    }();
+
+    int idx = static_cast<int>(type);
+    if (idx < 0 || idx >= static_cast<int>(table.size()) || !table[idx].load)
+        return nullptr;
+    return &table[idx];
 }
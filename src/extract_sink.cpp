@@ -0,0 +1,205 @@
+#include "extract_sink.hpp"
+#include "assets.hpp"
+#include "logging.hpp"
+
+static std::string to_forward_slashes(std::string_view name)
+{
+    std::string out(name);
+    for (char& c : out)
+        if (c == '\\')
+            c = '/';
+    return out;
+}
+
+FilesystemSink::FilesystemSink(const std::string& outdir)
+    : root(outdir)
+{
+    std::string stem = root.filename().string();
+    csvpath = (root / "zone_source" / (stem + ".csv")).string();
+}
+
+fs::path FilesystemSink::resolve(std::string_view name) const
+{
+    fs::path p = root / fs::path(to_forward_slashes(name));
+    return p.make_preferred();
+}
+
+bool FilesystemSink::begin()
+{
+    std::error_code ec;
+    fs::create_directories(root / "zone_source", ec);
+
+    csvfile.open(csvpath);
+    if (!csvfile.is_open())
+    {
+        logging::error() << "Failed to create CSV: " << csvpath;
+        return false;
+    }
+    return true;
+}
+
+bool FilesystemSink::write_file(std::string_view name, binary_io::ByteSpan data)
+{
+    fs::path out_fs_path = resolve(name);
+    ensure_parent_dirs(out_fs_path);
+
+    std::ofstream outf(out_fs_path, std::ios::binary);
+    if (!outf.is_open())
+    {
+        logging::error() << "Failed to open for writing: " << out_fs_path.string();
+        return false;
+    }
+
+    outf.write(reinterpret_cast<const char*>(data.data()), data.size());
+    return static_cast<bool>(outf);
+}
+
+bool FilesystemSink::append_file(std::string_view name, binary_io::ByteSpan data)
+{
+    std::string key = to_forward_slashes(name);
+    auto it = appended.find(key);
+    if (it == appended.end())
+    {
+        fs::path out_fs_path = resolve(name);
+        ensure_parent_dirs(out_fs_path);
+
+        std::ofstream outf(out_fs_path, std::ios::binary | std::ios::app);
+        if (!outf.is_open())
+        {
+            logging::error() << "Failed to open for writing: " << out_fs_path.string();
+            return false;
+        }
+        it = appended.emplace(key, std::move(outf)).first;
+    }
+
+    it->second.write(reinterpret_cast<const char*>(data.data()), data.size());
+    return static_cast<bool>(it->second);
+}
+
+bool FilesystemSink::add_manifest_entry(std::string_view type, std::string_view name)
+{
+    csvfile << type << "," << to_forward_slashes(name) << "\n";
+    return static_cast<bool>(csvfile);
+}
+
+bool FilesystemSink::finish()
+{
+    bool ok = true;
+    for (auto& [name, outf] : appended)
+    {
+        outf.close();
+        if (outf.fail())
+            ok = false;
+    }
+    appended.clear();
+
+    csvfile.close();
+    return ok && !csvfile.fail();
+}
+
+ZipSink::ZipSink(const std::string& zippath, const std::string& zone_name)
+    : zippath(zippath), csvpath("zone_source/" + zone_name + ".csv")
+{
+}
+
+ZipSink::~ZipSink()
+{
+    if (open)
+        mz_zip_writer_end(&zip);
+}
+
+size_t ZipSink::write_callback(void* opaque, mz_uint64 file_ofs, const void* buf, size_t n)
+{
+    auto* self = static_cast<ZipSink*>(opaque);
+    if (static_cast<mz_uint64>(self->out.tellp()) != file_ofs)
+        self->out.seekp(static_cast<std::streamoff>(file_ofs));
+    self->out.write(static_cast<const char*>(buf), n);
+    return self->out ? n : 0;
+}
+
+bool ZipSink::begin()
+{
+    ensure_parent_dirs(fs::path(zippath));
+
+    out.open(zippath, std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+    {
+        logging::error() << "Failed to create archive: " << zippath;
+        return false;
+    }
+
+    zip.m_pWrite = write_callback;
+    zip.m_pIO_opaque = this;
+    if (!mz_zip_writer_init(&zip, 0))
+    {
+        logging::error() << "Failed to initialize archive: " << zippath;
+        return false;
+    }
+    open = true;
+    return true;
+}
+
+bool ZipSink::write_file(std::string_view name, binary_io::ByteSpan data)
+{
+    std::string member = to_forward_slashes(name);
+    if (!mz_zip_writer_add_mem(&zip, member.c_str(), data.data(), data.size(), MZ_DEFAULT_LEVEL))
+    {
+        logging::error() << "Failed to add " << member << " to archive: " << mz_zip_get_error_string(mz_zip_get_last_error(&zip));
+        return false;
+    }
+    return true;
+}
+
+bool ZipSink::append_file(std::string_view name, binary_io::ByteSpan data)
+{
+    appended[to_forward_slashes(name)].append(reinterpret_cast<const char*>(data.data()), data.size());
+    return true;
+}
+
+bool ZipSink::add_manifest_entry(std::string_view type, std::string_view name)
+{
+    manifest.append(type).append(",").append(to_forward_slashes(name)).append("\n");
+    return true;
+}
+
+bool ZipSink::finish()
+{
+    if (!open)
+        return false;
+
+    bool ok = true;
+    for (auto& [name, content] : appended)
+        ok = write_file(name, binary_io::as_bytes(content)) && ok;
+    appended.clear();
+
+    ok = write_file(csvpath, binary_io::as_bytes(manifest)) && ok;
+
+    if (!mz_zip_writer_finalize_archive(&zip))
+    {
+        logging::error() << "Failed to finalize archive: " << zippath;
+        ok = false;
+    }
+    mz_zip_writer_end(&zip);
+    open = false;
+
+    out.close();
+    return ok && !out.fail();
+}
+
+bool MemorySink::write_file(std::string_view name, binary_io::ByteSpan data)
+{
+    contents[to_forward_slashes(name)].assign(reinterpret_cast<const char*>(data.data()), data.size());
+    return true;
+}
+
+bool MemorySink::append_file(std::string_view name, binary_io::ByteSpan data)
+{
+    contents[to_forward_slashes(name)].append(reinterpret_cast<const char*>(data.data()), data.size());
+    return true;
+}
+
+bool MemorySink::add_manifest_entry(std::string_view type, std::string_view name)
+{
+    csv.append(type).append(",").append(to_forward_slashes(name)).append("\n");
+    return true;
+}
@@ -1,188 +1,474 @@
 #include "assets.hpp"
-#include "assets.hpp"
 #include "util.hpp"
+#include "logging.hpp"
 #include "binary_io.hpp"
+#include "xxhash64.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
-#include <iostream>
 #include <sstream>
+#include <thread>
 #include <vector>
 
 namespace fs = std::filesystem;
 
-struct LocalizationEntry
+// The LANG_* names read from every .str: the languages being built, then ENGLISH, which fills in
+// values a language lacks.
+static std::vector<std::string> localize_columns(const fftools::LinkOptions& options)
+{
+    std::vector<std::string> columns;
+    for (std::string language : options.languages)
+    {
+        util::strtoupper(language);
+        columns.push_back(language);
+    }
+    if (std::find(columns.begin(), columns.end(), "ENGLISH") == columns.end())
+        columns.push_back("ENGLISH");
+    return columns;
+}
+
+static const std::uint32_t no_value = 0xFFFFFFFF;
+
+// A parsed .str in the layout of its cache: keys and NUL-terminated values in one blob, and per
+// entry the key offset and length, then an offset (no_value if missing) and length per column.
+struct ParsedStr
 {
-    std::string key;
-    std::string value;
+    std::string blob;
+    std::vector<std::uint32_t> table;
+    size_t count = 0;
 };
 
-static std::string unescape_string(const std::string& str)
+// Appends [p, end) with its escapes resolved; runs without a backslash are copied whole.
+static void append_unescaped(std::string& out, const char* p, const char* end)
 {
-    std::string result;
-    for (size_t i = 0; i < str.length(); ++i)
+    while (p < end)
     {
-        if (str[i] == '\\' && i + 1 < str.length())
+        const char* slash = static_cast<const char*>(std::memchr(p, '\\', static_cast<size_t>(end - p)));
+        if (!slash || slash + 1 == end)
         {
-            ++i;
-            switch (str[i])
-            {
-                case 'n': result += '\n'; break;
-                case 't': result += '\t'; break;
-                case 'r': result += '\r'; break;
-                case '\\': result += '\\'; break;
-                case '"': result += '"'; break;
-                case '0': result += '\0'; break;
-                default:
-                    result += '\\';
-                    result += str[i];
-                    break;
-            }
+            out.append(p, end);
+            return;
         }
-        else
+
+        out.append(p, slash);
+        switch (slash[1])
         {
-            result += str[i];
+            case 'n': out += '\n'; break;
+            case 't': out += '\t'; break;
+            case 'r': out += '\r'; break;
+            case '\\': out += '\\'; break;
+            case '"': out += '"'; break;
+            case '0': out += '\0'; break;
+            default:
+                out += '\\';
+                out += slash[1];
+                break;
         }
+        p = slash + 2;
     }
-    return result;
 }
 
-static std::string escape_string(const std::string& v)
+static void append_escaped(std::string& out, std::string_view v)
 {
-    std::string out;
-    for (char c : v)
+    const char* p = v.data();
+    const char* end = p + v.size();
+    while (p < end)
     {
-        switch (c)
+        const char* special = util::find_escapable(p, end);
+        out.append(p, special);
+        if (special == end)
+            return;
+
+        switch (*special)
         {
             case '\\': out += "\\\\"; break;
             case '"': out += "\\\""; break;
             case '\n': out += "\\n"; break;
             case '\r': out += "\\r"; break;
             case '\t': out += "\\t"; break;
-            default: out += c; break;
+            default: out += *special; break;
         }
+        p = special + 1;
     }
-    return out;
 }
 
-static std::vector<LocalizationEntry> parse_loc_file(const std::string& filename)
+static bool is_blank(char c)
 {
-    std::vector<LocalizationEntry> entries;
-    std::ifstream file(filename);
-    
-    if (!file.is_open())
-        return entries;
+    return c == ' ' || c == '\t';
+}
 
-    std::string line;
-    std::string current_key;
+// Single pass over the file: lines end at memchr hits, keywords are compared in place, and keys
+// and values go straight into the blob, so nothing is allocated per line.
+static ParsedStr parse_loc_file(std::string_view buffer, const std::vector<std::string>& columns)
+{
+    ParsedStr parsed;
+    parsed.blob.reserve(buffer.size());
+    const size_t stride = 2 + columns.size() * 2;
 
-    while (std::getline(file, line))
+    std::uint32_t key_off = 0, key_len = 0;
+    size_t current = std::string::npos;
+
+    const char* p = buffer.data();
+    const char* end = p + buffer.size();
+    while (p < end)
     {
-        size_t start = line.find_first_not_of(" \t");
-        if (start == std::string::npos)
-            continue;
+        const char* eol = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+        if (!eol)
+            eol = end;
+        const char* line = p;
+        p = eol == end ? end : eol + 1;
 
-        std::string trimmed = line.substr(start);
+        while (line < eol && is_blank(*line))
+            line++;
+        size_t len = static_cast<size_t>(eol - line);
 
-        if (trimmed.size() >= 9 && trimmed.substr(0, 9) == "REFERENCE")
+        if (len >= 9 && std::memcmp(line, "REFERENCE", 9) == 0)
         {
-            size_t key_start = trimmed.find_first_not_of(" \t", 9);
-            if (key_start != std::string::npos)
+            const char* key = line + 9;
+            while (key < eol && is_blank(*key))
+                key++;
+            if (key < eol)
             {
-                current_key = trimmed.substr(key_start);
-                size_t key_end = current_key.find_last_not_of(" \t\r\n");
-                if (key_end != std::string::npos)
-                    current_key = current_key.substr(0, key_end + 1);
+                // a key of nothing but line-end characters is kept as it is
+                const char* key_end = eol;
+                while (key_end > key && (is_blank(key_end[-1]) || key_end[-1] == '\r'))
+                    key_end--;
+                if (key_end == key)
+                    key_end = eol;
+
+                key_off = static_cast<std::uint32_t>(parsed.blob.size());
+                key_len = static_cast<std::uint32_t>(key_end - key);
+                parsed.blob.append(key, key_end);
             }
+            current = std::string::npos;
         }
-        else if (trimmed.size() >= 12 && trimmed.substr(0, 12) == "LANG_ENGLISH")
+        else if (len >= 5 && std::memcmp(line, "LANG_", 5) == 0)
         {
-            size_t val_start = trimmed.find('"');
-            if (val_start == std::string::npos)
+            const char* name = line + 5;
+            const char* name_end = name;
+            while (name_end < eol && !is_blank(*name_end) && *name_end != '"')
+                name_end++;
+            auto column = std::find(columns.begin(), columns.end(), std::string_view(name, static_cast<size_t>(name_end - name)));
+            if (column == columns.end())
                 continue;
 
-            val_start++;
-            size_t val_end = trimmed.rfind('"');
-            if (val_end == std::string::npos || val_end <= val_start)
+            const char* open = static_cast<const char*>(std::memchr(line, '"', len));
+            if (!open)
                 continue;
+            const char* close = eol - 1;
+            while (*close != '"')
+                close--;
+            if (close <= open + 1)
+                continue;
+
+            // a language given twice under one REFERENCE starts another entry of the same key
+            size_t slot = 2 + static_cast<size_t>(column - columns.begin()) * 2;
+            if (current == std::string::npos || parsed.table[current * stride + slot] != no_value)
+            {
+                current = parsed.count++;
+                parsed.table.push_back(key_off);
+                parsed.table.push_back(key_len);
+                for (size_t i = 0; i < columns.size(); i++)
+                {
+                    parsed.table.push_back(no_value);
+                    parsed.table.push_back(0);
+                }
+            }
 
-            std::string raw_value = trimmed.substr(val_start, val_end - val_start);
-            std::string value = unescape_string(raw_value);
+            std::uint32_t value_off = static_cast<std::uint32_t>(parsed.blob.size());
+            append_unescaped(parsed.blob, open + 1, close);
+            parsed.table[current * stride + slot] = value_off;
+            parsed.table[current * stride + slot + 1] = static_cast<std::uint32_t>(parsed.blob.size() - value_off);
+            parsed.blob.push_back('\0');
+        }
+    }
+
+    return parsed;
+}
+
+// Binary cache of a parsed .str under LinkOptions::cache_dir, named after the XXH64 of its path.
+// It is only used for a source of the recorded size and XXH64, parsed for the same LANG_* columns.
+// Little-endian:
+//   "IWffs002", u64 source hash, u64 source size, u64 columns hash, u32 entry count, u32 column count,
+//   u32 blob size, count * (u32 key offset, u32 key length, columns * (u32 value offset, u32 value length)), blob
+// A missing value has offset 0xFFFFFFFF. Values are NUL-terminated in the blob, so entries can point
+// straight into the mapped cache.
+static const char str_cache_magic[8] = {'I', 'W', 'f', 'f', 's', '0', '0', '2'};
+static const size_t str_cache_header = 44;
+
+// keys, and columns values per key (null where missing), pointing into a cache or a ParsedStr
+struct StrEntries
+{
+    std::vector<std::string_view> keys;
+    std::vector<const char*> values;
+};
+
+static std::uint64_t read_le(const char* p, int bytes)
+{
+    std::uint64_t v = 0;
+    for (int i = bytes - 1; i >= 0; i--)
+        v = (v << 8) | static_cast<unsigned char>(p[i]);
+    return v;
+}
+
+static std::uint64_t columns_hash(const std::vector<std::string>& columns)
+{
+    std::string joined;
+    for (const std::string& column : columns)
+        joined.append(column).push_back('\n');
+    return xxhash::xxh64(joined.data(), joined.size());
+}
+
+static std::string str_cache_name(LinkContext& ctx, const std::string& path)
+{
+    std::string source = ctx.input.describe(path);
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.strc", static_cast<unsigned long long>(xxhash::xxh64(source.data(), source.size())));
+    return name;
+}
+
+static bool read_str_cache(LinkContext& ctx, const std::string& name, std::uint64_t hash, size_t size,
+                           const std::vector<std::string>& columns, StrEntries& entries)
+{
+    FilesystemSource cache(ctx.options.cache_dir);
+    std::string_view bytes;
+    std::shared_ptr<void> mapping;
+    if (!cache.map(name, bytes, mapping) || bytes.size() < str_cache_header || std::memcmp(bytes.data(), str_cache_magic, 8) != 0)
+        return false;
+
+    const char* p = bytes.data();
+    if (read_le(p + 8, 8) != hash || read_le(p + 16, 8) != size || read_le(p + 24, 8) != columns_hash(columns) ||
+        read_le(p + 36, 4) != columns.size())
+        return false;
+
+    size_t count = static_cast<size_t>(read_le(p + 32, 4));
+    size_t blob_size = static_cast<size_t>(read_le(p + 40, 4));
+    size_t stride = 8 + columns.size() * 8;
+    size_t available = bytes.size() - str_cache_header;
+    if (count > available / stride || available - count * stride != blob_size)
+        return false;
+
+    const char* table = p + str_cache_header;
+    const char* blob = table + count * stride;
+    entries.keys.reserve(count);
+    entries.values.reserve(count * columns.size());
+    for (size_t i = 0; i < count; i++)
+    {
+        const char* e = table + i * stride;
+        size_t key_off = static_cast<size_t>(read_le(e, 4)), key_len = static_cast<size_t>(read_le(e + 4, 4));
+        if (key_off > blob_size || key_len > blob_size - key_off)
+            return false;
+        entries.keys.push_back(std::string_view(blob + key_off, key_len));
 
-            entries.push_back({current_key, value});
+        for (size_t c = 0; c < columns.size(); c++)
+        {
+            const char* v = e + 8 + c * 8;
+            if (read_le(v, 4) == no_value)
+            {
+                entries.values.push_back(nullptr);
+                continue;
+            }
+            size_t value_off = static_cast<size_t>(read_le(v, 4)), value_len = static_cast<size_t>(read_le(v + 4, 4));
+            if (value_off > blob_size || value_len >= blob_size - value_off || blob[value_off + value_len] != '\0')
+                return false;
+            entries.values.push_back(blob + value_off);
         }
     }
 
-    file.close();
-    return entries;
+    ctx.retain(std::move(mapping));
+    return true;
 }
 
-int load_localize_entry(XAssetType type, const std::string& basename, const std::string& path)
+// Best effort: a cache that cannot be written only means the next link parses again. It is written
+// to a temporary name first so concurrent links never see half a file.
+static void write_str_cache(LinkContext& ctx, const std::string& name, std::uint64_t hash, size_t size,
+                            const std::vector<std::string>& columns, const ParsedStr& parsed)
 {
-    std::string tmp = basename + "/english/localizedstrings/" + path + ".str";
+    auto put = [](std::string& out, std::uint64_t v, int bytes)
+    {
+        for (int i = 0; i < bytes; i++)
+            out.push_back(static_cast<char>(v >> (i * 8)));
+    };
+
+    std::string table;
+    table.reserve(parsed.table.size() * 4);
+    for (std::uint32_t v : parsed.table)
+        put(table, v, 4);
+
+    std::string header(str_cache_magic, sizeof(str_cache_magic));
+    put(header, hash, 8);
+    put(header, size, 8);
+    put(header, columns_hash(columns), 8);
+    put(header, parsed.count, 4);
+    put(header, columns.size(), 4);
+    put(header, parsed.blob.size(), 4);
+
+    std::error_code ec;
+    fs::path dir(ctx.options.cache_dir);
+    fs::create_directories(dir, ec);
+
+    fs::path final_path = dir / name;
+    fs::path temp_path = dir / (name + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp");
+    {
+        std::ofstream out(temp_path, std::ios::binary);
+        out << header << table << parsed.blob;
+        if (!out)
+        {
+            out.close();
+            fs::remove(temp_path, ec);
+            return;
+        }
+    }
+    fs::rename(temp_path, final_path, ec);
+    if (ec)
+        fs::remove(temp_path, ec);
+}
+
+int load_localize_entry(LinkContext& ctx, XAssetType type, const std::string& path)
+{
+    std::string tmp = "english/localizedstrings/" + path + ".str";
 
     std::string prefix_str = fs::path(tmp).stem().string();
     util::strtoupper(prefix_str);
 
-    std::cout << "Loading localize entry: " << prefix_str << std::endl;
+    logging::verbose() << "Loading localize entry: " << prefix_str;
 
-    auto entries = parse_loc_file(tmp);
-    if (entries.empty())
+    // every language comes from the one file, so it is parsed once however many zones are built
+    std::vector<std::string> columns = localize_columns(ctx.options);
+    size_t english = static_cast<size_t>(std::find(columns.begin(), columns.end(), "ENGLISH") - columns.begin());
+    size_t languages = std::max<size_t>(1, ctx.options.languages.size());
+
+    std::string_view text;
+    std::shared_ptr<void> mapping;
+    StrEntries entries;
+    if (ctx.input.map(tmp, text, mapping))
     {
-        std::cerr << "Failed to parse localization file: " << tmp << std::endl;
+        bool use_cache = !ctx.options.cache_dir.empty();
+        std::uint64_t hash = use_cache ? xxhash::xxh64(text.data(), text.size()) : 0;
+        std::string cache_name = use_cache ? str_cache_name(ctx, tmp) : std::string();
+
+        if (!use_cache || !read_str_cache(ctx, cache_name, hash, text.size(), columns, entries))
+        {
+            entries = {};
+            auto parsed = std::make_shared<ParsedStr>(parse_loc_file(text, columns));
+            if (use_cache && parsed->count > 0)
+                write_str_cache(ctx, cache_name, hash, text.size(), columns, *parsed);
+
+            const size_t stride = 2 + columns.size() * 2;
+            entries.keys.reserve(parsed->count);
+            entries.values.reserve(parsed->count * columns.size());
+            for (size_t i = 0; i < parsed->count; i++)
+            {
+                const std::uint32_t* e = &parsed->table[i * stride];
+                entries.keys.push_back(std::string_view(parsed->blob.data() + e[0], e[1]));
+                for (size_t c = 0; c < columns.size(); c++)
+                    entries.values.push_back(e[2 + c * 2] == no_value ? nullptr : parsed->blob.data() + e[2 + c * 2]);
+            }
+            ctx.retain(std::move(parsed));
+        }
+    }
+
+    if (entries.keys.empty())
+    {
+        logging::error() << "Failed to parse localization file: " << ctx.input.describe(tmp);
         return 1;
     }
 
-    for (auto& entry : entries)
+    // The whole file is one asset. Names go into a single blob and values point into the mapped cache
+    // or the parsed blob, which the context keeps alive. A language without its own value falls back
+    // to english; one with neither leaves the entry out of that language's zone.
+    size_t count = entries.keys.size();
+    size_t names_size = 0;
+    for (std::string_view key : entries.keys)
+        names_size += prefix_str.size() + key.size() + 2;
+
+    auto group = ctx.alloc<LocalizeGroup>();
+    char* names = ctx.alloc_bytes(names_size);
+    auto values = ctx.alloc_array<const char*>(count * languages);
+    auto present = ctx.alloc_array<std::uint32_t>(languages);
+
+    char* name = names;
+    for (size_t i = 0; i < count; i++)
     {
-        std::string key = prefix_str + "_" + entry.key;
-        std::cout << "  " << key << " = " << entry.value << std::endl;
-
-        auto asset = new_xasset(type, "", path);
-        auto loc_entry = new LocalizeEntry();
-        asset->header->localize = loc_entry;
-        
-        loc_entry->name = new char[key.length() + 1];
-        std::copy(key.begin(), key.end(), const_cast<char*>(loc_entry->name));
-        const_cast<char*>(loc_entry->name)[key.length()] = '\0';
-        
-        loc_entry->value = new char[entry.value.length() + 1];
-        std::copy(entry.value.begin(), entry.value.end(), const_cast<char*>(loc_entry->value));
-        const_cast<char*>(loc_entry->value)[entry.value.length()] = '\0';
+        // the name ends at the first NUL in the zone anyway
+        std::string_view key = entries.keys[i];
+        key = key.substr(0, key.find('\0'));
+
+        std::memcpy(name, prefix_str.data(), prefix_str.size());
+        name[prefix_str.size()] = '_';
+        std::memcpy(name + prefix_str.size() + 1, key.data(), key.size());
+        name[prefix_str.size() + 1 + key.size()] = '\0';
+
+        const char* const* column_values = &entries.values[i * columns.size()];
+        for (size_t l = 0; l < languages; l++)
+        {
+            const char* value = column_values[l] ? column_values[l] : column_values[english];
+            values[i * languages + l] = value;
+            present[l] += value ? 1 : 0;
+        }
+
+        logging::debug() << "  " << name << " = " << (values[i * languages] ? values[i * languages] : "");
+        name += prefix_str.size() + key.size() + 2;
     }
 
+    group->count = static_cast<std::uint32_t>(count);
+    group->languages = static_cast<std::uint32_t>(languages);
+    group->names = names;
+    group->values = values;
+    group->present = present;
+
+    auto asset = new_xasset(ctx, type, "", path);
+    asset->header.localize_group = group;
+
     return 0;
 }
 
-int serialize_localize_entry(std::ofstream& fp, const XAssetHeader& asset)
+// Writes the group's entries with a value in the language being built, one LocalizeEntry each.
+int serialize_localize_entry(LinkContext& ctx, ZoneWriter& zw, const XAssetHeader& asset)
 {
-    binary_io::write_be32(fp, 0xFFFFFFFF);
-    binary_io::write_be32(fp, 0xFFFFFFFF);
+    const LocalizeGroup* group = asset.localize_group;
 
-    const LocalizeEntry* loc = asset.localize;
-    binary_io::write_string(fp, loc->value);
-    binary_io::write_string(fp, loc->name);
+    const char* name = group->names;
+    for (std::uint32_t i = 0; i < group->count; i++, name += std::strlen(name) + 1)
+    {
+        const char* value = group->values[i * group->languages + ctx.language];
+        if (!value)
+            continue;
+
+        zw.align(4);
+        std::uint32_t next = zw.next_pointer() + 8;
+        std::uint32_t value_ptr = pool_string(ctx, value, next);
+        std::uint32_t name_ptr = pool_string(ctx, name, next);
+        zw.write_pointer(value_ptr);
+        zw.write_pointer(name_ptr);
+
+        if (value_ptr == 0xFFFFFFFF)
+            zw.write_string(value);
+        if (name_ptr == 0xFFFFFFFF)
+            zw.write_string(name);
+    }
 
     return 0;
 }
 
-int extract_localize_entry(const unsigned char* buf, size_t buf_len, size_t& pos, const std::string& outdir, std::ofstream& csvfile)
+int extract_localize_entry(UnlinkContext& ctx, const binary_io::ByteSpan& zone, size_t& pos)
 {
-    (void)outdir;
-    (void)csvfile;
+    ctx.align_block(pos, 4);
 
-    if (pos + 8 > buf_len)
+    std::uint32_t value_ptr = 0, name_ptr = 0;
+    if (!zone.read_be32(pos, value_ptr) || !zone.read_be32(pos, name_ptr))
         return -1;
-    
-    pos += 8;
 
-    std::string value, name;
-    if (!read_string(buf, buf_len, pos, value)) return -1;
-    if (!read_string(buf, buf_len, pos, name)) return -1;
+    std::string_view value, name;
+    if (!ctx.read_string(zone, pos, value_ptr, value)) return -1;
+    if (!ctx.read_string(zone, pos, name_ptr, name)) return -1;
 
     size_t us = name.find('_');
-    std::string prefix;
-    std::string key;
-    if (us == std::string::npos)
+    std::string_view prefix;
+    std::string_view key;
+    if (us == std::string_view::npos)
     {
         prefix = "default";
         key = name;
@@ -193,37 +479,30 @@ int extract_localize_entry(const unsigned char* buf, size_t buf_len, size_t& pos
         key = name.substr(us + 1);
     }
 
-    std::string prefix_lower = prefix;
+    std::string prefix_lower(prefix);
     std::transform(prefix_lower.begin(), prefix_lower.end(), prefix_lower.begin(), [](unsigned char c){ return std::tolower(c); });
 
-    fs::path dir = fs::path(outdir) / "english" / "localizedstrings";
-    fs::create_directories(dir);
+    std::string strname = "english/localizedstrings/" + prefix_lower + ".str";
 
-    fs::path strpath = dir / (prefix_lower + ".str");
+    std::string entry;
+    entry.reserve(key.size() + value.size() + 32);
+    entry.append("REFERENCE ").append(key).append("\n");
+    entry.append("LANG_ENGLISH \"");
+    append_escaped(entry, value);
+    entry.append("\"\n");
 
+    if (!ctx.sink.append_file(strname, binary_io::as_bytes(entry)))
     {
-        std::ofstream sf(strpath.string(), std::ios::app);
-        if (!sf.is_open())
-        {
-            std::cerr << "Failed to open localize file for writing: " << strpath.string() << std::endl;
-            return -1;
-        }
-
-    sf << "REFERENCE " << key << "\n";
-    sf << "LANG_ENGLISH \"" << escape_string(value) << "\"\n";
-        sf.close();
+        logging::error() << "Failed to open localize file for writing: " << strname;
+        return -1;
     }
 
-    if (g_emitted_localize_prefixes.find(prefix_lower) == g_emitted_localize_prefixes.end())
+    if (ctx.emitted_localize_prefixes.insert(prefix_lower).second)
     {
-        g_emitted_localize_prefixes.insert(prefix_lower);
-        std::string csv_name = std::string("english/localizedstrings/") + prefix_lower + ".str";
-        for (char& c : csv_name)
-            if (c == '\\') c = '/';
-        csvfile << "localize," << prefix_lower << "\n";
+        ctx.sink.add_manifest_entry("localize", prefix_lower);
     }
 
-    std::cout << "Extracted Localize entry: " << prefix_lower << " -> " << key << std::endl;
+    logging::debug() << "Extracted Localize entry: " << prefix_lower << " -> " << key;
 
     return 0;
 }
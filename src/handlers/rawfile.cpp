@@ -1,167 +1,164 @@
 #include "assets.hpp"
-#include "assets.hpp"
 #include "util.hpp"
+#include "logging.hpp"
 #include "binary_io.hpp"
 #include "compression.hpp"
 #include <filesystem>
 #include <fstream>
-#include <iostream>
+#include <vector>
 
 namespace fs = std::filesystem;
 
-int load_raw_file(XAssetType type, const std::string& basename, const std::string& path)
+int load_raw_file(LinkContext& ctx, XAssetType type, const std::string& path)
 {
-    auto asset = new_xasset(type, "", path);
-    auto rf = new RawFile();
-    asset->header->rawfile = rf;
+    std::string buffer;
+    if (!ctx.input.read(path, buffer))
+    {
+        logging::error() << "Failed to open rawfile: " << ctx.input.describe(path);
+        return 1;
+    }
 
-    std::string tmp = basename + "/" + path;
-    std::string buffer = binary_io::read_file_to_memory(tmp);
+    auto asset = new_xasset(ctx, type, "", path);
+    auto rf = ctx.alloc<RawFile>();
+    asset->header.rawfile = rf;
 
-    rf->buffer = new char[buffer.length() + 1];
-    std::copy(buffer.begin(), buffer.end(), const_cast<char*>(rf->buffer));
-    const_cast<char*>(rf->buffer)[buffer.length()] = '\0';
     rf->len = static_cast<int>(buffer.length());
     rf->name = asset->filename.c_str();
 
+    // runs on the linker's loader threads, so rawfiles are compressed in parallel
+    if (ctx.options.compress_rawfiles && buffer.size() >= ctx.options.compress_min_size)
+    {
+        auto packed = compression::compress_data(reinterpret_cast<const unsigned char*>(buffer.data()), buffer.size());
+        if (!packed.empty() && packed.size() < buffer.size())
+        {
+            rf->buffer = ctx.copy_string(std::string_view(reinterpret_cast<const char*>(packed.data()), packed.size()));
+            rf->compressedLen = static_cast<int>(packed.size());
+            return 0;
+        }
+    }
+
+    rf->buffer = ctx.copy_string(buffer);
+
     return 0;
 }
 
-int serialize_raw_file(std::ofstream& fp, const XAssetHeader& asset)
+int serialize_raw_file(LinkContext& ctx, ZoneWriter& zw, const XAssetHeader& asset)
 {
+    (void)ctx;
+
     const RawFile* rf = asset.rawfile;
 
     std::uint32_t ptr = 0xFFFFFFFF;
-    binary_io::write_be32(fp, ptr);
-    binary_io::write_be32(fp, 0);
-    binary_io::write_be32(fp, rf->len);
-    binary_io::write_be32(fp, ptr);
+    zw.align(4);
+    zw.write_be32(ptr);
+    zw.write_be32(rf->compressedLen);
+    zw.write_be32(rf->len);
+    zw.write_be32(ptr);
+
+    zw.write_string(rf->name);
 
-    binary_io::write_string(fp, rf->name);
-    fp.write(rf->buffer, rf->len);
-    char null_byte = '\0';
-    fp.write(&null_byte, 1);
+    // compressed buffers are stored as-is; plain ones carry a trailing NUL
+    if (rf->compressedLen > 0)
+    {
+        zw.write(rf->buffer, rf->compressedLen);
+    }
+    else
+    {
+        zw.write(rf->buffer, rf->len);
+        char null_byte = '\0';
+        zw.write(&null_byte, 1);
+    }
 
     return 0;
 }
 
-int extract_raw_file(const unsigned char* buf, size_t buf_len, size_t& pos, const std::string& outdir, std::ofstream& csvfile)
+int extract_raw_file(UnlinkContext& ctx, const binary_io::ByteSpan& zone, size_t& pos)
 {
-    if (pos + 16 > buf_len)
+    ctx.align_block(pos, 4);
+
+    std::uint32_t ptr1 = 0, compressedLen = 0, content_len = 0, ptr2 = 0;
+    if (!zone.read_be32(pos, ptr1) || !zone.read_be32(pos, compressedLen) ||
+        !zone.read_be32(pos, content_len) || !zone.read_be32(pos, ptr2))
     {
-        std::cerr << "Truncated rawfile" << std::endl;
+        logging::error() << "Truncated rawfile";
         return -1;
     }
 
-    std::uint32_t ptr1 = util::read_be32(buf, pos);
-    pos += 4;
-    std::uint32_t compressedLen = util::read_be32(buf, pos);
-    pos += 4;
-    std::uint32_t content_len = util::read_be32(buf, pos);
-    pos += 4;
-    std::uint32_t ptr2 = util::read_be32(buf, pos);
-    pos += 4;
-
     (void)ptr1;
     (void)ptr2;
 
-    std::string name;
-    if (!read_string(buf, buf_len, pos, name))
+    std::string_view name;
+    if (!zone.read_string(pos, name))
+    {
+        logging::error() << "Failed to read filename";
+        return -1;
+    }
+
+    std::string sanitized_name = sanitize_for_print(std::string(name));
+
+    // the game loads compressedLen bytes for compressed files, len + 1 (trailing NUL) otherwise
+    binary_io::ByteSpan stored;
+    size_t stored_len = compressedLen > 0 ? compressedLen : static_cast<size_t>(content_len) + 1;
+    if (!zone.read_bytes(pos, stored_len, stored))
     {
-        std::cerr << "Failed to read filename" << std::endl;
+        logging::error() << "Truncated " << (compressedLen > 0 ? "compressed" : "raw") << " content for " << sanitized_name;
         return -1;
     }
 
-    std::string sanitized_name = sanitize_for_print(name);
-    std::string ffname_norm = normalize_basename_for_compare(outdir);
+    std::string ffname_norm = normalize_basename_for_compare(ctx.zone_name);
     std::string name_norm = normalize_basename_for_compare(sanitized_name);
     if (!ffname_norm.empty())
     {
         if (name_norm == ffname_norm || name_norm.find(ffname_norm) != std::string::npos || sanitized_name.find(ffname_norm) != std::string::npos)
         {
-            std::cout << "Skipping auto-generated file: " << sanitized_name << std::endl;
+            logging::verbose() << "Skipping auto-generated file: " << sanitized_name;
             return 0;
         }
     }
 
-    std::string content;
+    if (content_len == 0)
+    {
+        logging::verbose() << "Skipping empty auto-generated file: " << sanitized_name;
+        return 0;
+    }
+
     if (compressedLen > 0)
     {
-        if (pos + compressedLen > buf_len)
+        // compressedLen was bounded by the zone when it was read; the inflated size only by the cap
+        if (content_len > MAX_UNLINK_SIZE)
         {
-            std::cerr << "Truncated compressed content for " << sanitized_name << std::endl;
+            logging::error() << "Invalid length for " << sanitized_name;
             return -1;
         }
-        auto decompressed = compression::decompress_data(buf + pos, compressedLen, static_cast<size_t>(content_len));
-        if (decompressed.empty())
+
+        // inflated on the workers into a buffer of exactly content_len bytes; stored stays
+        // valid until the unlink finishes, so the task only captures the view
+        bool submitted = ctx.workers.submit([&sink = ctx.sink, sanitized_name, stored, content_len]()
         {
-            if (compressedLen == content_len)
+            std::string content(content_len, '\0');
+            if (!compression::inflate_exact(stored.data(), stored.size(), reinterpret_cast<unsigned char*>(&content[0]), content.size()))
             {
-                if (pos + compressedLen > buf_len)
+                // some tools set compressedLen == len for files they stored uncompressed
+                if (stored.size() != content_len)
                 {
-                    std::cerr << "Truncated raw fallback for " << sanitized_name << std::endl;
-                    return -1;
+                    logging::error() << "Failed to decompress content for " << sanitized_name;
+                    return false;
                 }
-                content.assign(reinterpret_cast<const char*>(buf + pos), compressedLen);
-                pos += compressedLen;
-            }
-            else
-            {
-                std::cerr << "Failed to decompress content for " << sanitized_name << std::endl;
-                return -1;
+                content.assign(reinterpret_cast<const char*>(stored.data()), stored.size());
             }
-        }
-        else
-        {
-            content.assign(reinterpret_cast<const char*>(decompressed.data()), decompressed.size());
-            pos += compressedLen;
-        }
-    }
-    else
-    {
-        if (pos + content_len > buf_len)
-        {
-            std::cerr << "Truncated raw content for " << sanitized_name << std::endl;
+            return sink.take_file(sanitized_name, std::move(content));
+        });
+        if (!submitted)
             return -1;
-        }
-        content.assign(reinterpret_cast<const char*>(buf + pos), content_len);
-        pos += content_len;
-    }
-
-    if (content.empty())
-    {
-        std::cout << "Skipping empty auto-generated file: " << sanitized_name << std::endl;
-        return 0;
     }
-
-    std::string outpath = outdir + "/" + sanitized_name;
-    fs::path out_fs_path(outpath);
-
-    std::string path_str = out_fs_path.string();
-    for (char& c : path_str)
-        if (c == '/')
-            c = '\\';
-    out_fs_path = fs::path(path_str);
-
-    ensure_parent_dirs(out_fs_path);
-
-    std::ofstream outf(out_fs_path, std::ios::binary);
-    if (!outf.is_open())
+    else if (!ctx.sink.write_file(sanitized_name, stored.subspan(0, content_len)))
     {
-        std::cerr << "Failed to open for writing: " << out_fs_path << std::endl;
         return -1;
     }
 
-    outf.write(content.c_str(), content.size());
-    outf.close();
-
-    std::cout << "Extracted: " << out_fs_path.string() << " (" << content.size() << " bytes)" << std::endl;
+    logging::verbose() << "Extracted: " << sanitized_name << " (" << content_len << " bytes)";
 
-    std::string csv_name = sanitized_name;
-    for (char& c : csv_name)
-        if (c == '\\')
-            c = '/';
-    csvfile << "rawfile," << csv_name << "\n";
+    ctx.sink.add_manifest_entry("rawfile", sanitized_name);
 
     return 0;
 }
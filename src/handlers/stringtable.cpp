@@ -1,243 +1,517 @@
 #include "assets.hpp"
-#include "assets.hpp"
 #include "util.hpp"
+#include "logging.hpp"
 #include "binary_io.hpp"
+#include <algorithm>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
-#include <iostream>
+#include <thread>
 #include <vector>
 
 namespace fs = std::filesystem;
 
-static std::vector<std::string> split_csv_line(const std::string& line, char delimiter = ',')
+// Lowers ASCII 'A'-'Z' in all 8 bytes at once and leaves every other byte (including >= 0x80) as is.
+static std::uint64_t ascii_lower8(std::uint64_t block)
+{
+    const std::uint64_t high = 0x8080808080808080ULL;
+    std::uint64_t heptets = block & ~high;
+    std::uint64_t above_z = heptets + 0x2525252525252525ULL;   // high bit set where byte > 'Z'
+    std::uint64_t from_a = heptets + 0x3F3F3F3F3F3F3F3FULL;    // high bit set where byte >= 'A'
+    std::uint64_t upper = (from_a ^ above_z) & ~block & high;
+    return block | (upper >> 2);
+}
+
+// The game's case-insensitive cell hash, hash * 31 + tolower(c) over signed chars, where the CRT's
+// "C" locale tolower only lowers 'A'-'Z'. Eight bytes go in per step as
+// hash * 31^8 + c0 * 31^7 + ... + c7, so the multiplies no longer form one long dependency chain.
+static std::uint32_t stringtable_hash(const char* string, size_t len)
 {
-    std::vector<std::string> result;
-    std::string current;
-    bool inQuotes = false;
+    auto sext = [](unsigned char c) { return static_cast<std::uint32_t>(static_cast<std::int32_t>(static_cast<signed char>(c))); };
 
-    for (size_t i = 0; i < line.length(); i++)
+    std::uint32_t hash = 0;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8)
     {
-        char c = line[i];
+        std::uint64_t block;
+        std::memcpy(&block, string + i, 8);
+        block = ascii_lower8(block);
+
+        unsigned char c[8];
+        std::memcpy(c, &block, 8);
+        // powers of 31, mod 2^32
+        hash = hash * 2487512833u + sext(c[0]) * 1742810335u + sext(c[1]) * 887503681u +
+            sext(c[2]) * 28629151u + sext(c[3]) * 923521u + sext(c[4]) * 29791u + sext(c[5]) * 961u +
+            sext(c[6]) * 31u + sext(c[7]);
+    }
 
-        if (c == '"')
-        {
-            inQuotes = !inQuotes;
-        }
-        else if (c == delimiter && !inQuotes)
-        {
-            result.push_back(current);
-            current.clear();
-        }
-        else
-        {
-            current += c;
-        }
+    for (; i < len; i++)
+    {
+        unsigned char c = static_cast<unsigned char>(string[i]);
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+        hash = hash * 31 + sext(c);
     }
-    result.push_back(current);
-    return result;
+
+    return hash;
 }
 
-static int stringtable_hash(const char* string)
+// Hashes cells [begin, end) of the table into hashes.
+static void hash_cells(const StringTable* st, int* hashes, size_t begin, size_t end)
 {
-    int hash = 0;
-    const char* data = string;
+    for (size_t i = begin; i < end; i++)
+        hashes[i] = static_cast<int>(stringtable_hash(st->text + st->offsets[i], st->offsets[i + 1] - st->offsets[i] - 1));
+}
+
+// Large tables are hashed on several threads, each taking a contiguous range of whole rows.
+static void hash_string_table(const StringTable* st, int* hashes)
+{
+    const size_t cells_per_thread = 64 * 1024;
 
-    while (*data != 0)
+    size_t totalCells = static_cast<size_t>(st->rowCount) * st->columnCount;
+    size_t threads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), totalCells / cells_per_thread);
+    if (threads < 2)
     {
-        hash = tolower(*data) + (31 * hash);
-        data++;
+        hash_cells(st, hashes, 0, totalCells);
+        return;
     }
 
-    return hash;
+    size_t rows_per_thread = (st->rowCount + threads - 1) / threads;
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < threads; t++)
+    {
+        size_t begin = std::min<size_t>(t * rows_per_thread, st->rowCount) * st->columnCount;
+        size_t end = std::min<size_t>((t + 1) * rows_per_thread, st->rowCount) * st->columnCount;
+        pool.emplace_back(hash_cells, st, hashes, begin, end);
+    }
+    hash_cells(st, hashes, 0, std::min<size_t>(rows_per_thread, st->rowCount) * st->columnCount);
+    for (auto& t : pool)
+        t.join();
 }
 
-int load_string_table(XAssetType type, const std::string& basename, const std::string& path)
+// Splits the csv into rows of cells in one pass, handing each cell to on_cell(std::string_view) and
+// the end of each row to on_row(). Lines end at '\n' (a trailing '\r' is dropped); quotes never
+// span lines and are dropped, they only stop ',' from splitting, and "" inside quotes is a literal
+// quote. Cells without quotes are views into text, quoted ones are unquoted into scratch first.
+template <typename OnCell, typename OnRow>
+static void scan_csv(std::string_view text, std::string& scratch, OnCell&& on_cell, OnRow&& on_row)
 {
-    auto asset = new_xasset(type, "", path);
-    auto st = new StringTable();
-    asset->header->stringtable = st;
+    const char* p = text.data();
+    const char* end = p + text.size();
 
-    std::string tmp = basename + "/" + path;
-    std::ifstream file(tmp);
-    if (!file.is_open())
+    while (p < end)
     {
-        std::cerr << "Failed to open stringtable file: " << tmp << std::endl;
-        return 1;
+        const char* cell = p;
+        for (;;)
+        {
+            const char* hit = util::find_any_of(p, end, ',', '"', '\n');
+            if (hit < end && *hit == ',')
+            {
+                on_cell(std::string_view(cell, hit - cell));
+                p = cell = hit + 1;
+                continue;
+            }
+
+            const char* line_end = (hit < end && *hit == '\n') ? hit : static_cast<const char*>(std::memchr(hit, '\n', end - hit));
+            if (!line_end)
+                line_end = end;
+            const char* content_end = (line_end > cell && line_end[-1] == '\r') ? line_end - 1 : line_end;
+
+            if (hit < end && *hit == '"')
+            {
+                scratch.clear();
+                bool inQuotes = false;
+                const char* c = cell;
+                for (; c < content_end; c++)
+                {
+                    if (*c == '"' && inQuotes && c + 1 < content_end && c[1] == '"')
+                        scratch.push_back(*c++);
+                    else if (*c == '"')
+                        inQuotes = !inQuotes;
+                    else if (*c == ',' && !inQuotes)
+                        break;
+                    else
+                        scratch.push_back(*c);
+                }
+                on_cell(std::string_view(scratch));
+
+                if (c < content_end)
+                {
+                    p = cell = c + 1;
+                    continue;
+                }
+            }
+            else
+            {
+                on_cell(std::string_view(cell, content_end - cell));
+            }
+
+            p = line_end < end ? line_end + 1 : end;
+            break;
+        }
+        on_row();
     }
+}
 
-    std::vector<std::vector<std::string>> rows;
-    std::string line;
-    int maxColumns = 0;
+// Copies every cell into blob followed by a NUL and records where it starts. Each NUL takes the
+// place of a delimiter, so blob needs at most text.size() + 1 bytes. Returns how many were used.
+static size_t tokenize_csv(std::string_view text, char* blob, std::vector<std::uint32_t>& offsets, std::vector<int>& row_sizes)
+{
+    std::string scratch;
+    char* out = blob;
+    size_t row_start = 0;
 
-    while (std::getline(file, line))
-    {
-        if (!line.empty() && line.back() == '\r')
-            line.pop_back();
+    scan_csv(text, scratch,
+        [&](std::string_view cell)
+        {
+            offsets.push_back(static_cast<std::uint32_t>(out - blob));
+            std::memcpy(out, cell.data(), cell.size());
+            out += cell.size();
+            *out++ = '\0';
+        },
+        [&]()
+        {
+            row_sizes.push_back(static_cast<int>(offsets.size() - row_start));
+            row_start = offsets.size();
+        });
+
+    return static_cast<size_t>(out - blob);
+}
 
-        auto cells = split_csv_line(line, ',');
-        rows.push_back(cells);
-        
-        if (static_cast<int>(cells.size()) > maxColumns)
-            maxColumns = static_cast<int>(cells.size());
+// Rebuilds blob and offsets with empty cells appended to rows shorter than columns.
+static void pad_rows(LinkContext& ctx, char*& blob, size_t& used, std::vector<std::uint32_t>& offsets, const std::vector<int>& row_sizes, int columns)
+{
+    size_t totalCells = row_sizes.size() * static_cast<size_t>(columns);
+    char* padded = ctx.alloc_bytes(used + (totalCells - offsets.size()));
+    std::vector<std::uint32_t> padded_offsets;
+    padded_offsets.reserve(totalCells + 1);
+
+    size_t cell = 0;
+    char* out = padded;
+    for (int size : row_sizes)
+    {
+        size_t from = offsets[cell];
+        size_t to = cell + size < offsets.size() ? offsets[cell + size] : used;
+        for (int col = 0; col < size; col++)
+            padded_offsets.push_back(static_cast<std::uint32_t>(offsets[cell + col] - from + (out - padded)));
+        std::memcpy(out, blob + from, to - from);
+        out += to - from;
+
+        for (int col = size; col < columns; col++)
+        {
+            padded_offsets.push_back(static_cast<std::uint32_t>(out - padded));
+            *out++ = '\0';
+        }
+        cell += size;
     }
-    file.close();
 
-    st->name = asset->filename.c_str();
-    st->rowCount = static_cast<int>(rows.size());
+    blob = padded;
+    used = static_cast<size_t>(out - padded);
+    offsets = std::move(padded_offsets);
+}
+
+// Columnar load: the cells are copied out once, so the mapping is released when this returns.
+static void load_columnar(LinkContext& ctx, StringTable* st, std::string_view text)
+{
+    char* blob = ctx.alloc_bytes(text.size() + 1);
+    auto offsets = ctx.alloc<std::vector<std::uint32_t>>();
+    std::vector<int> row_sizes;
+    size_t used = tokenize_csv(text, blob, *offsets, row_sizes);
+
+    int maxColumns = 0;
+    for (int size : row_sizes)
+        maxColumns = std::max(maxColumns, size);
+
+    st->rowCount = static_cast<int>(row_sizes.size());
     st->columnCount = maxColumns;
 
-    int totalCells = st->rowCount * st->columnCount;
-    st->values = new StringTableCell[totalCells];
+    size_t totalCells = static_cast<size_t>(st->rowCount) * st->columnCount;
+    if (offsets->size() != totalCells)
+        pad_rows(ctx, blob, used, *offsets, row_sizes, maxColumns);
+    offsets->push_back(static_cast<std::uint32_t>(used));
 
-    for (int row = 0; row < st->rowCount; row++)
-    {
-        for (int col = 0; col < st->columnCount; col++)
+    st->text = blob;
+    st->offsets = offsets->data();
+
+    int* hashes = ctx.alloc_array<int>(totalCells);
+    hash_string_table(st, hashes);
+    st->hashes = hashes;
+}
+
+// Streamed load, first pass: only the shape and the hashes are kept. The mapping stays alive and
+// serialize_string_table() tokenizes it again to write the strings.
+static void load_streamed(LinkContext& ctx, StringTable* st, std::string_view text, std::shared_ptr<void> mapping)
+{
+    auto hashes = ctx.alloc<std::vector<int>>();
+    std::vector<int> row_sizes;
+    std::string scratch;
+    size_t row_start = 0;
+
+    scan_csv(text, scratch,
+        [&](std::string_view cell) { hashes->push_back(static_cast<int>(stringtable_hash(cell.data(), cell.size()))); },
+        [&]()
         {
-            int cellIndex = (row * st->columnCount) + col;
-            
-            std::string cellValue;
-            if (col < static_cast<int>(rows[row].size()))
-                cellValue = rows[row][col];
-            else
-                cellValue = "";
+            row_sizes.push_back(static_cast<int>(hashes->size() - row_start));
+            row_start = hashes->size();
+        });
 
-            char* cellStr = new char[cellValue.length() + 1];
-            std::copy(cellValue.begin(), cellValue.end(), cellStr);
-            cellStr[cellValue.length()] = '\0';
+    int maxColumns = 0;
+    for (int size : row_sizes)
+        maxColumns = std::max(maxColumns, size);
+
+    st->rowCount = static_cast<int>(row_sizes.size());
+    st->columnCount = maxColumns;
 
-            st->values[cellIndex].string = cellStr;
-            st->values[cellIndex].hash = stringtable_hash(cellStr);
+    // padding cells are empty, and the hash of "" is 0
+    size_t totalCells = static_cast<size_t>(st->rowCount) * st->columnCount;
+    if (hashes->size() != totalCells)
+    {
+        std::vector<int> padded(totalCells, 0);
+        size_t cell = 0;
+        for (size_t row = 0; row < row_sizes.size(); row++)
+        {
+            std::copy_n(hashes->begin() + cell, row_sizes[row], padded.begin() + row * maxColumns);
+            cell += row_sizes[row];
         }
+        *hashes = std::move(padded);
     }
 
-    std::cout << "Loaded StringTable: " << tmp << " (" << st->rowCount << " rows, " << st->columnCount << " columns)" << std::endl;
+    st->source = text;
+    st->hashes = hashes->data();
+    ctx.retain(std::move(mapping));
+}
+
+int load_string_table(LinkContext& ctx, XAssetType type, const std::string& path)
+{
+    std::string tmp = ctx.input.describe(path);
+    std::string_view text;
+    std::shared_ptr<void> mapping;
+    if (!ctx.input.map(path, text, mapping))
+    {
+        logging::error() << "Failed to open stringtable file: " << tmp;
+        return 1;
+    }
+
+    auto asset = new_xasset(ctx, type, "", path);
+    auto st = ctx.alloc<StringTable>();
+    asset->header.stringtable = st;
+    st->name = asset->filename.c_str();
+
+    bool streamed = ctx.options.stream_tables_over > 0 && text.size() > ctx.options.stream_tables_over;
+    if (streamed)
+        load_streamed(ctx, st, text, std::move(mapping));
+    else
+        load_columnar(ctx, st, text);
+
+    logging::verbose() << "Loaded StringTable: " << tmp << " (" << st->rowCount << " rows, " << st->columnCount << " columns"
+              << (streamed ? ", streamed" : "") << ")";
 
     return 0;
 }
 
-int serialize_string_table(std::ofstream& fp, const XAssetHeader& asset)
+// The pointer/hash pairs of a table whose cells are all inline, in one sweep.
+static void write_inline_cell_pairs(ZoneWriter& zw, const int* hashes, size_t count)
+{
+    unsigned char* pairs = zw.grow(count * 8);
+    for (size_t i = 0; i < count; i++)
+    {
+        std::uint32_t hash = static_cast<std::uint32_t>(hashes[i]);
+        unsigned char* pair = pairs + i * 8;
+        pair[0] = pair[1] = pair[2] = pair[3] = 0xFF;
+        pair[4] = static_cast<unsigned char>(hash >> 24);
+        pair[5] = static_cast<unsigned char>(hash >> 16);
+        pair[6] = static_cast<unsigned char>(hash >> 8);
+        pair[7] = static_cast<unsigned char>(hash);
+    }
+}
+
+// Second pass of a streamed table: the csv is tokenized again (twice with pooling, which needs every
+// pointer before the first string) and the strings go straight into the zone.
+static void write_streamed_cells(LinkContext& ctx, ZoneWriter& zw, const StringTable* st)
+{
+    std::string scratch;
+    auto for_each_cell = [&](auto&& fn)
+    {
+        int col = 0;
+        scan_csv(st->source, scratch,
+            [&](std::string_view cell) { fn(cell); col++; },
+            [&]()
+            {
+                for (; col < st->columnCount; col++)
+                    fn(std::string_view());
+                col = 0;
+            });
+    };
+
+    size_t totalCells = static_cast<size_t>(st->rowCount) * st->columnCount;
+    if (!ctx.options.pool_strings)
+    {
+        write_inline_cell_pairs(zw, st->hashes, totalCells);
+        for_each_cell([&](std::string_view cell) { zw.write_string(cell); });
+        return;
+    }
+
+    std::vector<std::uint32_t> cellPtrs;
+    cellPtrs.reserve(totalCells);
+    std::uint32_t next = zw.next_pointer() + static_cast<std::uint32_t>(totalCells) * 8;
+    for_each_cell([&](std::string_view cell) { cellPtrs.push_back(pool_string(ctx, cell, next)); });
+
+    for (size_t i = 0; i < totalCells; i++)
+    {
+        zw.write_pointer(cellPtrs[i]);
+        zw.write_be32(st->hashes[i]);
+    }
+
+    size_t i = 0;
+    for_each_cell([&](std::string_view cell)
+    {
+        if (cellPtrs[i++] == 0xFFFFFFFF)
+            zw.write_string(cell);
+    });
+}
+
+int serialize_string_table(LinkContext& ctx, ZoneWriter& zw, const XAssetHeader& asset)
 {
     const StringTable* st = asset.stringtable;
 
     std::uint32_t ptr = 0xFFFFFFFF;
-    binary_io::write_be32(fp, ptr);
-    binary_io::write_be32(fp, st->columnCount);
-    binary_io::write_be32(fp, st->rowCount);
-    binary_io::write_be32(fp, ptr);
+    zw.align(4);
+    zw.write_be32(ptr);
+    zw.write_be32(st->columnCount);
+    zw.write_be32(st->rowCount);
+    zw.write_be32(ptr);
+
+    zw.write_string(st->name);
 
-    binary_io::write_string(fp, st->name);
+    size_t totalCells = static_cast<size_t>(st->rowCount) * st->columnCount;
+    zw.align(4);
 
-    int totalCells = st->rowCount * st->columnCount;
-    for (int i = 0; i < totalCells; i++)
+    if (!st->text)
     {
-        binary_io::write_be32(fp, ptr);
-        binary_io::write_be32(fp, st->values[i].hash);
+        write_streamed_cells(ctx, zw, st);
+        return 0;
     }
 
-    for (int i = 0; i < totalCells; i++)
+    if (!ctx.options.pool_strings)
     {
-        binary_io::write_string(fp, st->values[i].string);
+        // every cell is inline, and the blob already is the game's string section
+        write_inline_cell_pairs(zw, st->hashes, totalCells);
+        zw.write(st->text, st->offsets[totalCells]);
+        return 0;
+    }
+
+    auto cell = [st](size_t i) { return std::string_view(st->text + st->offsets[i], st->offsets[i + 1] - st->offsets[i] - 1); };
+
+    // cell strings follow the pointer array, so where each inline one lands is known up front
+    std::vector<std::uint32_t> cellPtrs(totalCells);
+    std::uint32_t next = zw.next_pointer() + static_cast<std::uint32_t>(totalCells) * 8;
+    for (size_t i = 0; i < totalCells; i++)
+        cellPtrs[i] = pool_string(ctx, cell(i), next);
+
+    for (size_t i = 0; i < totalCells; i++)
+    {
+        zw.write_pointer(cellPtrs[i]);
+        zw.write_be32(st->hashes[i]);
+    }
+
+    for (size_t i = 0; i < totalCells; i++)
+    {
+        if (cellPtrs[i] == ptr)
+            zw.write_string(cell(i));
     }
 
     return 0;
 }
 
-int extract_string_table(const unsigned char* buf, size_t buf_len, size_t& pos, const std::string& outdir, std::ofstream& csvfile)
+// Appends cell as a csv field, quoted when it holds a ',' or '"' (doubled inside the quotes) or a
+// '\r' the loader would otherwise drop at the end of a line.
+static void append_csv_cell(std::string& out, std::string_view cell)
 {
-    if (pos + 16 > buf_len)
+    if (cell.find_first_of(",\"\r") == std::string_view::npos)
     {
-        std::cerr << "Truncated stringtable header" << std::endl;
-        return -1;
+        out.append(cell);
+        return;
     }
 
-    std::uint32_t name_ptr = util::read_be32(buf, pos);
-    pos += 4;
-    std::uint32_t columnCount = util::read_be32(buf, pos);
-    pos += 4;
-    std::uint32_t rowCount = util::read_be32(buf, pos);
-    pos += 4;
-    std::uint32_t values_ptr = util::read_be32(buf, pos);
-    pos += 4;
+    out.push_back('"');
+    for (char c : cell)
+    {
+        if (c == '"')
+            out.push_back('"');
+        out.push_back(c);
+    }
+    out.push_back('"');
+}
 
-    (void)name_ptr;
-    (void)values_ptr;
+int extract_string_table(UnlinkContext& ctx, const binary_io::ByteSpan& zone, size_t& pos)
+{
+    ctx.align_block(pos, 4);
 
-    std::string name;
-    if (!read_string(buf, buf_len, pos, name))
+    std::uint32_t name_ptr = 0, columnCount = 0, rowCount = 0, values_ptr = 0;
+    if (!zone.read_be32(pos, name_ptr) || !zone.read_be32(pos, columnCount) ||
+        !zone.read_be32(pos, rowCount) || !zone.read_be32(pos, values_ptr))
     {
-        std::cerr << "Failed to read stringtable name" << std::endl;
+        logging::error() << "Truncated stringtable header";
         return -1;
     }
 
-    int totalCells = rowCount * columnCount;
-    
-    if (pos + (totalCells * 8) > buf_len)
+    (void)name_ptr;
+    (void)values_ptr;
+
+    std::string_view name;
+    if (!zone.read_string(pos, name))
     {
-        std::cerr << "Truncated stringtable cells" << std::endl;
+        logging::error() << "Failed to read stringtable name";
         return -1;
     }
 
-    std::vector<std::uint32_t> string_ptrs(totalCells);
-    std::vector<std::uint32_t> hashes(totalCells);
+    size_t totalCells = static_cast<size_t>(rowCount) * columnCount;
+    ctx.align_block(pos, 4);
 
-    for (int i = 0; i < totalCells; i++)
+    // hashes are not needed to rebuild the csv (only to verify it); pointers say whether a cell is inline or pooled
+    binary_io::ByteSpan cells;
+    if (totalCells > zone.max_size() / 8 || !zone.read_bytes(pos, totalCells * 8, cells))
     {
-        string_ptrs[i] = util::read_be32(buf, pos);
-        pos += 4;
-        hashes[i] = util::read_be32(buf, pos);
-        pos += 4;
+        logging::error() << "Truncated stringtable cells";
+        return -1;
     }
 
-    std::vector<std::string> cellStrings(totalCells);
-    for (int i = 0; i < totalCells; i++)
+    // rows are assembled straight from the strings in the zone into one buffer, written in one go
+    std::string out;
+    out.reserve(totalCells * 8);
+    size_t mismatches = 0;
+    for (size_t i = 0; i < totalCells; i++)
     {
-        if (!read_string(buf, buf_len, pos, cellStrings[i]))
+        size_t cellPos = i * 8;
+        std::uint32_t cellPtr = 0, hash = 0;
+        std::string_view cell;
+        if (!cells.read_be32(cellPos, cellPtr) || !cells.read_be32(cellPos, hash) ||
+            !ctx.read_string(zone, pos, cellPtr, cell))
         {
-            std::cerr << "Failed to read stringtable cell string" << std::endl;
+            logging::error() << "Failed to read stringtable cell string";
             return -1;
         }
-    }
-
-    std::string outpath = outdir + "/" + name;
-    fs::path out_fs_path(outpath);
-
-    std::string path_str = out_fs_path.string();
-    for (char& c : path_str)
-        if (c == '/')
-            c = '\\';
-    out_fs_path = fs::path(path_str);
-
-    ensure_parent_dirs(out_fs_path);
 
-    std::ofstream outf(out_fs_path);
-    if (!outf.is_open())
-    {
-        std::cerr << "Failed to open for writing: " << out_fs_path << std::endl;
-        return -1;
-    }
-
-    for (std::uint32_t row = 0; row < rowCount; row++)
-    {
-        for (std::uint32_t col = 0; col < columnCount; col++)
+        if (ctx.verify_hashes && stringtable_hash(cell.data(), cell.size()) != hash)
         {
-            int cellIndex = (row * columnCount) + col;
-            outf << cellStrings[cellIndex];
-            
-            if (col < columnCount - 1)
-                outf << ",";
+            if (mismatches++ < 8)
+                logging::error() << "Stringtable hash mismatch: " << name << " row " << i / columnCount << ", column " << i % columnCount
+                          << " (stored 0x" << logging::hex(static_cast<std::uint32_t>(hash)) << ", computed 0x" << logging::hex(stringtable_hash(cell.data(), cell.size())) << ")";
         }
-        outf << "\n";
+
+        append_csv_cell(out, cell);
+        out.push_back((i + 1) % columnCount == 0 ? '\n' : ',');
     }
+    ctx.hash_mismatches += mismatches;
+    if (columnCount == 0)
+        out.append(rowCount, '\n');
 
-    outf.close();
+    if (!ctx.sink.write_file(name, binary_io::as_bytes(out)))
+        return -1;
 
-    std::cout << "Extracted StringTable: " << out_fs_path.string() << " (" << rowCount << " rows, " << columnCount << " columns)" << std::endl;
+    logging::verbose() << "Extracted StringTable: " << name << " (" << rowCount << " rows, " << columnCount << " columns)";
 
-    std::string csv_name = name;
-    for (char& c : csv_name)
-        if (c == '\\')
-            c = '/';
-    csvfile << "stringtable," << csv_name << "\n";
+    ctx.sink.add_manifest_entry("stringtable", name);
 
     return 0;
 }
@@ -1,18 +1,26 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <memory>
+#include <vector>
 #include <fstream>
 #include <filesystem>
+#include <unordered_map>
 #include <unordered_set>
 
 #include "types.hpp"
+#include "binary_io.hpp"
+#include "extract_sink.hpp"
+#include "input_source.hpp"
+#include "zone_writer.hpp"
+#include "fftools.hpp"
+#include "worker_pool.hpp"
+#include "script_string_table.hpp"
 
 
 namespace fs = std::filesystem;
 
-bool read_string(const unsigned char* buf, size_t buf_len, size_t& pos, std::string& out);
-extern std::unordered_set<std::string> g_emitted_localize_prefixes;
 void ensure_parent_dirs(const fs::path& filepath);
 std::string trim_and_lower(std::string s);
 std::string normalize_basename_for_compare(const std::string& path);
@@ -23,13 +31,119 @@ struct Asset
 	std::string filename;
 	std::string name;
 	XAssetType type = XAssetType::ASSETLIST;
-	std::unique_ptr<XAssetHeader> header;
-	std::shared_ptr<Asset> next;
+	XAssetHeader header = {};
 };
 
-typedef int(*AssetLoadHandler)(XAssetType type, const std::string& basename, const std::string& path);
-typedef int(*AssetSerializeHandler)(std::ofstream& fp, const XAssetHeader& asset);
-typedef int(*AssetExtractHandler)(const unsigned char* buf, size_t buf_len, size_t& pos, const std::string& outdir, std::ofstream& csvfile);
+// Everything one link job owns. Handlers allocate asset data through it, so it is
+// released with the job and concurrent links never share state.
+class LinkContext
+{
+public:
+	LinkContext(const std::string& name, InputSource& input, const fftools::LinkOptions& options = {})
+		: name(name), input(input), options(options) {}
+	LinkContext(const LinkContext&) = delete;
+	LinkContext& operator=(const LinkContext&) = delete;
+
+	std::string name;
+	InputSource& input;
+	fftools::LinkOptions options;
+	std::vector<std::unique_ptr<Asset>> assets;
+
+	// zone pointers of strings already serialized, for pool_string(); keys view copies in this context
+	std::unordered_map<std::string_view, std::uint32_t> string_pool;
+
+	// zone-wide script strings; intern while serializing, since the table is written after every asset
+	ScriptStringTable script_strings;
+
+	// index into options.languages of the zone being serialized; localize entries hold a value per language
+	size_t language = 0;
+
+	template <typename T>
+	T* alloc()
+	{
+		auto owned = std::make_shared<T>();
+		storage.push_back(owned);
+		return owned.get();
+	}
+
+	template <typename T>
+	T* alloc_array(size_t count)
+	{
+		std::shared_ptr<T[]> owned(new T[count]());
+		storage.push_back(std::shared_ptr<void>(owned, owned.get()));
+		return owned.get();
+	}
+
+	char* alloc_bytes(size_t len);
+	const char* copy_string(std::string_view str);
+
+	// keeps a mapped input (InputSource::map) alive for as long as assets point into it
+	void retain(std::shared_ptr<void> owned)
+	{
+		if (owned)
+			storage.push_back(std::move(owned));
+	}
+
+private:
+	std::vector<std::shared_ptr<void>> storage;
+	std::vector<std::unique_ptr<char[]>> blocks;
+	char* block_cursor = nullptr;
+	size_t block_remaining = 0;
+};
+
+// Per-unlink state: where extracted files go and what has been emitted so far.
+// Handlers may push slow per-asset work (e.g. inflating) to workers; those tasks may only
+// call sink.write_file()/take_file() and must not touch the rest of the context.
+class UnlinkContext
+{
+public:
+	UnlinkContext(const std::string& zone_name, ExtractSink& sink, WorkerPool& workers)
+		: zone_name(zone_name), sink(sink), workers(workers) {}
+	UnlinkContext(const UnlinkContext&) = delete;
+	UnlinkContext& operator=(const UnlinkContext&) = delete;
+
+	std::string zone_name;
+	ExtractSink& sink;
+	WorkerPool& workers;
+	std::unordered_set<std::string> emitted_localize_prefixes;
+
+	// recompute stored hashes while extracting (UnlinkOptions::verify_hashes) and count the ones that differ
+	bool verify_hashes = false;
+	size_t hash_mismatches = 0;
+
+	// the zone's script strings, by index
+	std::vector<std::string_view> script_strings;
+
+	bool script_string(std::uint16_t index, std::string_view& out) const
+	{
+		if (index >= script_strings.size())
+			return false;
+		out = script_strings[index];
+		return true;
+	}
+
+	// Mirrors the linker's large-block accounting so zone pointers (pooled strings) can be mapped
+	// back to positions: begin_block() at the first asset, align_block() wherever the linker aligns.
+	void begin_block(size_t pos);
+	void align_block(size_t pos, size_t alignment);
+	bool resolve_pointer(std::uint32_t ptr, size_t& pos) const;
+
+	// reads a string the zone stores inline at pos (ptr 0xFFFFFFFF) or at an earlier zone pointer
+	bool read_string(const binary_io::ByteSpan& zone, size_t& pos, std::uint32_t ptr, std::string_view& out) const;
+
+private:
+	// block offsets from offset on live at zone position pos + (offset - this offset)
+	struct BlockSegment
+	{
+		size_t offset;
+		size_t pos;
+	};
+	std::vector<BlockSegment> segments;
+};
+
+typedef int(*AssetLoadHandler)(LinkContext& ctx, XAssetType type, const std::string& path);
+typedef int(*AssetSerializeHandler)(LinkContext& ctx, ZoneWriter& zw, const XAssetHeader& asset);
+typedef int(*AssetExtractHandler)(UnlinkContext& ctx, const binary_io::ByteSpan& zone, size_t& pos);
 
 struct AssetHandler
 {
@@ -38,21 +152,22 @@ struct AssetHandler
 	AssetExtractHandler extract;
 };
 
-extern std::shared_ptr<Asset> assets;
-extern AssetHandler asset_handlers[static_cast<int>(XAssetType::ASSETLIST)];
+// Pointer to serialize for str, which would be written inline at zone pointer next: a back-reference
+// to an earlier copy when string pooling is on and one exists, else 0xFFFFFFFF and next moves past str.
+std::uint32_t pool_string(LinkContext& ctx, std::string_view str, std::uint32_t& next);
 
-void init_asset_handlers();
-std::shared_ptr<Asset> new_xasset(XAssetType type, const std::string& name, const std::string& filename);
-int asset_count();
+// handler table is immutable; returns nullptr for types without handlers
+const AssetHandler* find_asset_handler(XAssetType type);
+Asset* new_xasset(LinkContext& ctx, XAssetType type, const std::string& name, const std::string& filename);
 
-int load_localize_entry(XAssetType type, const std::string& basename, const std::string& path);
-int serialize_localize_entry(std::ofstream& fp, const XAssetHeader& asset);
-int extract_localize_entry(const unsigned char* buf, size_t buf_len, size_t& pos, const std::string& outdir, std::ofstream& csvfile);
+int load_localize_entry(LinkContext& ctx, XAssetType type, const std::string& path);
+int serialize_localize_entry(LinkContext& ctx, ZoneWriter& zw, const XAssetHeader& asset);
+int extract_localize_entry(UnlinkContext& ctx, const binary_io::ByteSpan& zone, size_t& pos);
 
-int load_raw_file(XAssetType type, const std::string& basename, const std::string& path);
-int serialize_raw_file(std::ofstream& fp, const XAssetHeader& asset);
-int extract_raw_file(const unsigned char* buf, size_t buf_len, size_t& pos, const std::string& outdir, std::ofstream& csvfile);
+int load_raw_file(LinkContext& ctx, XAssetType type, const std::string& path);
+int serialize_raw_file(LinkContext& ctx, ZoneWriter& zw, const XAssetHeader& asset);
+int extract_raw_file(UnlinkContext& ctx, const binary_io::ByteSpan& zone, size_t& pos);
 
-int load_string_table(XAssetType type, const std::string& basename, const std::string& path);
-int serialize_string_table(std::ofstream& fp, const XAssetHeader& asset);
-int extract_string_table(const unsigned char* buf, size_t buf_len, size_t& pos, const std::string& outdir, std::ofstream& csvfile);
\ No newline at end of file
+int load_string_table(LinkContext& ctx, XAssetType type, const std::string& path);
+int serialize_string_table(LinkContext& ctx, ZoneWriter& zw, const XAssetHeader& asset);
+int extract_string_table(UnlinkContext& ctx, const binary_io::ByteSpan& zone, size_t& pos);
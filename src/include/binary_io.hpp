@@ -1,7 +1,10 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
 #include <string>
+#include <string_view>
 #include <fstream>
 #include <memory>
 
@@ -43,4 +46,114 @@ namespace binary_io
 
 		return buffer;
 	}
+
+	// Progress and wait interface of the inflater filling a ByteSpan's buffer.
+	class ByteStream
+	{
+	public:
+		virtual ~ByteStream() = default;
+
+		// blocks until at least want bytes are available or the stream has ended; returns the bytes available
+		virtual size_t wait_for(size_t want) const = 0;
+	};
+
+	// Bounds-checked, non-owning view over a byte buffer (usually the inflated zone).
+	// Every read either succeeds entirely or leaves pos untouched and returns false.
+	class ByteSpan
+	{
+	public:
+		ByteSpan() = default;
+		ByteSpan(const unsigned char* data, size_t size) : data_(data), size_(size), capacity_(size) {}
+
+		// view over a buffer of capacity bytes that stream is still filling; reads wait for their bytes
+		ByteSpan(const unsigned char* data, size_t capacity, const ByteStream& stream)
+			: data_(data), size_(0), capacity_(capacity), stream_(&stream) {}
+
+		const unsigned char* data() const { return data_; }
+		size_t size() const { return size_; }
+		bool empty() const { return size_ == 0; }
+
+		// upper bound on size(), for sanity checks on counts read from the data
+		size_t max_size() const { return capacity_; }
+
+		bool contains(size_t pos, size_t len) const
+		{
+			if (pos <= size_ && len <= size_ - pos)
+				return true;
+			return stream_ && pos <= capacity_ && len <= capacity_ - pos && grow(pos + len);
+		}
+
+		ByteSpan subspan(size_t pos, size_t len) const
+		{
+			if (!contains(pos, len))
+				return ByteSpan();
+			return ByteSpan(data_ + pos, len);
+		}
+
+		bool skip(size_t& pos, size_t len) const
+		{
+			if (!contains(pos, len))
+				return false;
+			pos += len;
+			return true;
+		}
+
+		bool read_be32(size_t& pos, std::uint32_t& out) const
+		{
+			if (!contains(pos, 4))
+				return false;
+			out = (static_cast<std::uint32_t>(data_[pos]) << 24) | (static_cast<std::uint32_t>(data_[pos + 1]) << 16) |
+			      (static_cast<std::uint32_t>(data_[pos + 2]) << 8) | data_[pos + 3];
+			pos += 4;
+			return true;
+		}
+
+		bool read_bytes(size_t& pos, size_t len, ByteSpan& out) const
+		{
+			if (!contains(pos, len))
+				return false;
+			out = ByteSpan(data_ + pos, len);
+			pos += len;
+			return true;
+		}
+
+		// reads a NUL-terminated string; the terminator is consumed but not part of out
+		bool read_string(size_t& pos, std::string_view& out) const
+		{
+			if (!contains(pos, 1))
+				return false;
+			size_t scanned = pos;
+			const void* nul;
+			while (!(nul = std::memchr(data_ + scanned, '\0', size_ - scanned)))
+			{
+				scanned = size_;
+				if (!stream_ || size_ >= capacity_ || !grow(size_ + 1))
+					return false;
+			}
+			size_t len = static_cast<const unsigned char*>(nul) - (data_ + pos);
+			out = std::string_view(reinterpret_cast<const char*>(data_ + pos), len);
+			pos += len + 1;
+			return true;
+		}
+
+	private:
+		bool grow(size_t want) const
+		{
+			size_t available = stream_->wait_for(want);
+			if (available <= size_)
+				return false;
+			size_ = std::min(available, capacity_);
+			return size_ >= want;
+		}
+
+		const unsigned char* data_ = nullptr;
+		mutable size_t size_ = 0;
+		size_t capacity_ = 0;
+		const ByteStream* stream_ = nullptr;
+	};
+
+	inline ByteSpan as_bytes(std::string_view s)
+	{
+		return ByteSpan(reinterpret_cast<const unsigned char*>(s.data()), s.size());
+	}
 }
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <cstdint>
+#include <cstring>
+#include <cstdlib>
 #include <vector>
 #include <memory>
 #include "miniz.h"
@@ -112,4 +114,158 @@ namespace compression
 		mz_inflateEnd(&d_stream);
 		return output;
 	}
+
+	// inflates a complete zlib stream into exactly out_len bytes; false on a corrupt stream or a size mismatch
+	inline bool inflate_exact(const unsigned char* data, size_t data_len, unsigned char* out, size_t out_len)
+	{
+		mz_ulong produced = static_cast<mz_ulong>(out_len);
+		if (mz_uncompress(out, &produced, data, static_cast<mz_ulong>(data_len)) != MZ_OK)
+			return false;
+		return produced == out_len;
+	}
+
+	// Incremental zlib inflate of an input that is fully in memory, into caller-provided space.
+	class Inflater
+	{
+	public:
+		Inflater(const unsigned char* data, size_t len)
+		{
+			memset(&stream, 0, sizeof(stream));
+			stream.zalloc = reinterpret_cast<mz_alloc_func>(myalloc);
+			stream.zfree = reinterpret_cast<mz_free_func>(myfree);
+			stream.next_in = data;
+			stream.avail_in = static_cast<unsigned int>(len);
+			initialized = mz_inflateInit(&stream) == MZ_OK;
+		}
+
+		~Inflater()
+		{
+			if (initialized)
+				mz_inflateEnd(&stream);
+		}
+
+		Inflater(const Inflater&) = delete;
+		Inflater& operator=(const Inflater&) = delete;
+
+		// MZ_OK while more output follows, MZ_STREAM_END once the stream is complete, anything else on error
+		int inflate(unsigned char* out, size_t out_len, size_t& produced)
+		{
+			produced = 0;
+			if (!initialized)
+				return MZ_STREAM_ERROR;
+
+			stream.next_out = out;
+			stream.avail_out = static_cast<unsigned int>(out_len);
+			int err = mz_inflate(&stream, MZ_NO_FLUSH);
+			produced = out_len - stream.avail_out;
+			return err;
+		}
+
+	private:
+		mz_stream stream;
+		bool initialized = false;
+	};
+
+	// zlib's adler32_combine(): checksum of A||B from the checksums of A and B and B's length
+	inline std::uint32_t adler32_combine(std::uint32_t adler1, std::uint32_t adler2, std::uint64_t len2)
+	{
+		const std::uint32_t base = 65521;
+		std::uint32_t rem = static_cast<std::uint32_t>(len2 % base);
+		std::uint32_t sum1 = adler1 & 0xFFFF;
+		std::uint32_t sum2 = static_cast<std::uint32_t>((static_cast<std::uint64_t>(rem) * sum1) % base);
+		sum1 += (adler2 & 0xFFFF) + base - 1;
+		sum2 += (adler1 >> 16) + (adler2 >> 16) + base - rem;
+		if (sum1 >= base) sum1 -= base;
+		if (sum1 >= base) sum1 -= base;
+		if (sum2 >= (base << 1)) sum2 -= (base << 1);
+		if (sum2 >= base) sum2 -= base;
+		return sum1 | (sum2 << 16);
+	}
+
+	// Incremental raw deflate (no zlib header or trailer). Pieces of one zlib stream can be
+	// produced separately: end every piece but the last with MZ_SYNC_FLUSH (byte aligned,
+	// no final block), the last one with MZ_FINISH, then frame them with zlib_header()/zlib_trailer().
+	class RawDeflater
+	{
+	public:
+		explicit RawDeflater(int level = MZ_DEFAULT_COMPRESSION)
+		{
+			memset(&stream, 0, sizeof(stream));
+			stream.zalloc = reinterpret_cast<mz_alloc_func>(myalloc);
+			stream.zfree = reinterpret_cast<mz_free_func>(myfree);
+			initialized = mz_deflateInit2(&stream, level, MZ_DEFLATED, -MZ_DEFAULT_WINDOW_BITS, 9, MZ_DEFAULT_STRATEGY) == MZ_OK;
+		}
+
+		~RawDeflater()
+		{
+			if (initialized)
+				mz_deflateEnd(&stream);
+		}
+
+		RawDeflater(const RawDeflater&) = delete;
+		RawDeflater& operator=(const RawDeflater&) = delete;
+
+		bool deflate(const unsigned char* data, size_t len, int flush, std::vector<unsigned char>& out)
+		{
+			if (!initialized)
+				return false;
+
+			// mz_adler32() restarts the checksum when handed a null pointer
+			if (len > 0)
+				adler = static_cast<std::uint32_t>(mz_adler32(adler, data, len));
+			total_in += len;
+
+			if (len == 0 && flush == MZ_NO_FLUSH)
+				return true;
+
+			stream.next_in = data;
+			stream.avail_in = static_cast<unsigned int>(len);
+
+			const size_t step = 64 * 1024;
+			for (;;)
+			{
+				size_t used = out.size();
+				out.resize(used + step);
+				stream.next_out = out.data() + used;
+				stream.avail_out = static_cast<unsigned int>(step);
+
+				int err = mz_deflate(&stream, flush);
+				out.resize(used + step - stream.avail_out);
+
+				if (err == MZ_STREAM_END)
+					return true;
+				if (err != MZ_OK)
+					return false;
+
+				// without a flush, whatever the compressor still holds comes out with a later piece;
+				// asking again once the input is used up only gets MZ_BUF_ERROR
+				if (stream.avail_in == 0 && (flush == MZ_NO_FLUSH || (stream.avail_out != 0 && flush != MZ_FINISH)))
+					return true;
+			}
+		}
+
+		std::uint32_t checksum() const { return adler; }
+		std::uint64_t consumed() const { return total_in; }
+
+	private:
+		mz_stream stream;
+		bool initialized = false;
+		std::uint32_t adler = 1;
+		std::uint64_t total_in = 0;
+	};
+
+	// zlib stream framing around raw deflate pieces (default-level header, adler-32 trailer)
+	inline void zlib_header(std::vector<unsigned char>& out)
+	{
+		out.push_back(0x78);
+		out.push_back(0x9C);
+	}
+
+	inline void zlib_trailer(std::vector<unsigned char>& out, std::uint32_t adler)
+	{
+		out.push_back(static_cast<unsigned char>(adler >> 24));
+		out.push_back(static_cast<unsigned char>(adler >> 16));
+		out.push_back(static_cast<unsigned char>(adler >> 8));
+		out.push_back(static_cast<unsigned char>(adler));
+	}
 }
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <fstream>
+#include <filesystem>
+#include <map>
+#include <unordered_map>
+
+#include "binary_io.hpp"
+#include "miniz.h"
+
+namespace fs = std::filesystem;
+
+// Destination for everything an unlink produces: extracted asset files and
+// the zone_source manifest. Names are zone-relative and may use either slash.
+class ExtractSink
+{
+public:
+	virtual ~ExtractSink() = default;
+
+	virtual bool begin() = 0;
+	virtual bool write_file(std::string_view name, binary_io::ByteSpan data) = 0;
+	virtual bool append_file(std::string_view name, binary_io::ByteSpan data) = 0;
+	virtual bool add_manifest_entry(std::string_view type, std::string_view name) = 0;
+	virtual bool finish() = 0;
+
+	// same as write_file(), for callers that can hand over their buffer instead of keeping it alive
+	virtual bool take_file(std::string_view name, std::string&& data) { return write_file(name, binary_io::as_bytes(data)); }
+
+	// true if write_file() may run on several threads at once, alongside the other calls
+	virtual bool concurrent_writes() const { return false; }
+};
+
+// Loose files under <outdir>/, manifest at <outdir>/zone_source/<outdir>.csv
+class FilesystemSink : public ExtractSink
+{
+public:
+	explicit FilesystemSink(const std::string& outdir);
+
+	bool begin() override;
+	bool write_file(std::string_view name, binary_io::ByteSpan data) override;
+	bool append_file(std::string_view name, binary_io::ByteSpan data) override;
+	bool add_manifest_entry(std::string_view type, std::string_view name) override;
+	bool finish() override;
+	bool concurrent_writes() const override { return true; }
+
+	const std::string& manifest_path() const { return csvpath; }
+
+private:
+	fs::path resolve(std::string_view name) const;
+
+	fs::path root;
+	std::string csvpath;
+	std::ofstream csvfile;
+	std::unordered_map<std::string, std::ofstream> appended;
+};
+
+// Single .zip archive laid out like the loose-file tree (zone_source/<name>.csv at the root).
+// Appended files and the manifest are buffered and stored when the archive is finished.
+class ZipSink : public ExtractSink
+{
+public:
+	ZipSink(const std::string& zippath, const std::string& zone_name);
+	~ZipSink() override;
+
+	bool begin() override;
+	bool write_file(std::string_view name, binary_io::ByteSpan data) override;
+	bool append_file(std::string_view name, binary_io::ByteSpan data) override;
+	bool add_manifest_entry(std::string_view type, std::string_view name) override;
+	bool finish() override;
+
+	const std::string& manifest_path() const { return csvpath; }
+
+private:
+	static size_t write_callback(void* opaque, mz_uint64 file_ofs, const void* buf, size_t n);
+
+	std::string zippath;
+	std::string csvpath;
+	std::ofstream out;
+	mz_zip_archive zip = {};
+	bool open = false;
+	std::string manifest;
+	std::map<std::string, std::string> appended;
+};
+
+// Keeps every output in memory; nothing touches the disk.
+class MemorySink : public ExtractSink
+{
+public:
+	bool begin() override { return true; }
+	bool write_file(std::string_view name, binary_io::ByteSpan data) override;
+	bool append_file(std::string_view name, binary_io::ByteSpan data) override;
+	bool add_manifest_entry(std::string_view type, std::string_view name) override;
+	bool finish() override { return true; }
+
+	const std::map<std::string, std::string>& files() const { return contents; }
+	const std::string& manifest() const { return csv; }
+
+private:
+	std::map<std::string, std::string> contents;
+	std::string csv;
+};
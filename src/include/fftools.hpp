@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "binary_io.hpp"
+#include "extract_sink.hpp"
+#include "input_source.hpp"
+
+// Embeddable link/unlink entry points; linker.exe and unlinker.exe are thin front-ends over these.
+namespace fftools
+{
+	struct LinkOptions
+	{
+		unsigned threads = 0;       // asset loader threads; 0 = one per core
+		bool keep_zone = false;     // keep the uncompressed zone for zone()
+
+		// store rawfiles of at least compress_min_size bytes zlib-compressed, when that is smaller
+		bool compress_rawfiles = false;
+		size_t compress_min_size = 1024;
+
+		// write repeated stringtable cells and localize strings once and point back to the first copy
+		bool pool_strings = false;
+
+		// stringtables whose csv is larger than this are only hashed on load and tokenized again from
+		// the mapped file while serializing, so their text is never held in memory (0: never)
+		size_t stream_tables_over = 64 * 1024 * 1024;
+
+		// directory for binary caches of parsed .str files, reused while the source is unchanged (empty: none)
+		std::string cache_dir;
+
+		// languages to build, lowercase ("english", "french", ...): each .str supplies the LANG_<NAME>
+		// value, or LANG_ENGLISH where that is missing. link() builds the first (empty: english only)
+		std::vector<std::string> languages;
+
+		// warn when an XFILE block needs more than this many bytes (0: never); the default is what
+		// every zone used to reserve
+		size_t block_limit = 5000000;
+	};
+
+	struct UnlinkOptions
+	{
+		unsigned threads = 0;       // output writer threads; 0 = one per core
+
+		// recompute every stringtable cell hash and fail the unlink if one differs from the zone
+		bool verify_hashes = false;
+	};
+
+	// Builds a fastfile from a zone_source manifest, reading every asset through input.
+	// Like Unlinker, every int-returning call gives 0 on success and 1 on failure.
+	class Linker
+	{
+	public:
+		Linker(const std::string& name, InputSource& input, const LinkOptions& options = {});
+
+		// manifest is the text of zone_source/<name>.csv; ff receives the complete .ff/.ffm bytes
+		int link(std::string_view manifest, std::vector<unsigned char>& ff);
+
+		// one fastfile per LinkOptions::languages entry from a single load of the manifest; ffs[i] is
+		// languages[i]. Only localize entries differ, everything else is serialized once and shared
+		int link_languages(std::string_view manifest, std::vector<std::vector<unsigned char>>& ffs);
+
+		// loads and serializes manifest lines (usually a single "type,path") into a relocatable object (.ffo)
+		int compile(std::string_view entries, std::vector<unsigned char>& object);
+
+		// stitches compiled objects into a zone, in order, and builds the fastfile like link()
+		int link_objects(const std::vector<binary_io::ByteSpan>& objects, std::vector<unsigned char>& ff);
+
+		// uncompressed zone from the last successful link (the .ffraw), per language after
+		// link_languages(); empty unless keep_zone is set
+		const std::vector<unsigned char>& zone(size_t language = 0) const { return raw[language]; }
+
+	private:
+		std::string name;
+		InputSource& input;
+		LinkOptions options;
+		std::vector<std::vector<unsigned char>> raw;
+
+		int link_zones(std::string_view manifest, size_t languages, std::vector<std::vector<unsigned char>>& ffs);
+	};
+
+	// Extracts every supported asset from fastfile bytes into sink. unlink() returns 0 on success
+	// and 1 on failure.
+	class Unlinker
+	{
+	public:
+		// zone_name is the output root name; rawfiles named after it are treated as auto-generated
+		explicit Unlinker(const std::string& zone_name, const UnlinkOptions& options = {});
+
+		int unlink(binary_io::ByteSpan ff, ExtractSink& sink);
+
+	private:
+		std::string zone_name;
+		UnlinkOptions options;
+	};
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+
+// Where the linker reads the mod tree from. Paths are relative to the mod root
+// (e.g. "zone_source/patch.csv", "maps/mp/_load.gsc") and may use either slash.
+// read() is called from several loader threads at once and must be thread-safe.
+class InputSource
+{
+public:
+	virtual ~InputSource() = default;
+
+	virtual bool read(const std::string& path, std::string& out) = 0;
+	virtual std::string describe(const std::string& path) const = 0;
+
+	// file on disk that holds path, for dependency lists
+	virtual std::string file(const std::string& path) const { return describe(path); }
+
+	// Read-only view of path, valid while owner (and the source) are alive. Sources that can hand
+	// out the bytes without copying them override this; by default the file is read into owner.
+	virtual bool map(const std::string& path, std::string_view& out, std::shared_ptr<void>& owner);
+};
+
+// <root>/<path> on disk
+class FilesystemSource : public InputSource
+{
+public:
+	explicit FilesystemSource(const std::string& root) : root(root) {}
+
+	bool read(const std::string& path, std::string& out) override;
+	std::string describe(const std::string& path) const override;
+
+	// memory-maps the file
+	bool map(const std::string& path, std::string_view& out, std::shared_ptr<void>& owner) override;
+
+private:
+	std::string root;
+};
+
+// Members of a .zip holding the mod tree. open() only indexes the archive; a member is inflated
+// when a loader asks for it, so several members inflate at once on the loader threads.
+class ZipSource : public InputSource
+{
+public:
+	explicit ZipSource(const std::string& zippath);
+	~ZipSource() override;
+
+	bool open(const std::string& modname);
+
+	// inflates straight into out; nothing is kept
+	bool read(const std::string& path, std::string& out) override;
+	std::string describe(const std::string& path) const override;
+	std::string file(const std::string&) const override { return zippath; }
+
+	// inflates the member once and views it; no owner is needed
+	bool map(const std::string& path, std::string_view& out, std::shared_ptr<void>& owner) override;
+
+	// the archive as open() read it
+	std::string_view contents() const { return archive; }
+
+private:
+	struct Member
+	{
+		unsigned index = 0;
+		size_t size = 0;
+		std::once_flag inflated;
+		bool ok = false;
+		std::string contents;
+	};
+
+	// miniz reader state; each is used by one thread at a time
+	struct Reader;
+
+	static std::string normalize(const std::string& path);
+	Member* find(const std::string& path) const;
+	bool inflate(const std::string& path, const Member& member, char* out);
+
+	std::string zippath;
+	std::string prefix;
+	std::string archive;
+	std::unordered_map<std::string, std::unique_ptr<Member>> members;
+
+	std::mutex readers_lock;
+	std::vector<std::unique_ptr<Reader>> readers;   // idle
+};
+
+// Forwards to another source and remembers every path asked for, with a digest of what was read
+// (linker --depfile and the no-op build fingerprint).
+class RecordingSource : public InputSource
+{
+public:
+	struct Read
+	{
+		bool found;
+		std::uint64_t digest;   // XXH64 of the contents; 0 when not found
+	};
+
+	explicit RecordingSource(InputSource& inner) : inner(inner) {}
+
+	bool read(const std::string& path, std::string& out) override;
+	std::string describe(const std::string& path) const override { return inner.describe(path); }
+	std::string file(const std::string& path) const override { return inner.file(path); }
+	bool map(const std::string& path, std::string_view& out, std::shared_ptr<void>& owner) override;
+
+	// files behind the successful reads; sorted, each file once
+	std::vector<std::string> files() const;
+
+	// every path asked for, including ones that did not exist
+	std::map<std::string, Read> reads() const;
+
+private:
+	void record(const std::string& path, bool found, std::string_view data);
+
+	InputSource& inner;
+	mutable std::mutex lock;
+	std::set<std::string> read_files;
+	std::map<std::string, Read> read_paths;
+};
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Level-filtered console output. Info and verbose lines are appended to a per-thread ring buffer
+// without locking and written to stdout by a background thread; warnings and errors first flush
+// everything logged before them and then go to stderr synchronously, so they keep their place
+// and are never lost. Lines below the current level are not even formatted.
+//
+//     logging::info() << "Writing fastfile: " << path;
+namespace logging
+{
+	enum class Level
+	{
+		error,
+		warning,    // -q: nothing below this
+		info,       // default: progress and results
+		verbose,    // -v: one line per asset
+		debug,      // -vv: everything, e.g. every localize string
+	};
+
+	void set_level(Level level);
+	Level level();
+
+	inline bool enabled(Level l) { return l <= level(); }
+
+	// writes out every line logged so far
+	void flush();
+
+	// emits a finished line (no trailing newline) at the given level
+	void write(Level level, std::string_view text);
+
+	struct Hex
+	{
+		std::uint64_t value;
+	};
+
+	inline Hex hex(std::uint64_t value) { return {value}; }
+
+	// One line, built into a per-thread scratch string and emitted when the statement ends.
+	class Line
+	{
+	public:
+		explicit Line(Level level) : level(level), on(enabled(level)), start(on ? scratch().size() : 0) {}
+
+		~Line()
+		{
+			if (!on)
+				return;
+			std::string& text = scratch();
+			write(level, std::string_view(text).substr(start));
+			text.resize(start);
+		}
+
+		Line(const Line&) = delete;
+		Line& operator=(const Line&) = delete;
+
+		Line& operator<<(std::string_view s)
+		{
+			if (on)
+				scratch().append(s);
+			return *this;
+		}
+
+		Line& operator<<(const char* s) { return *this << std::string_view(s ? s : ""); }
+		Line& operator<<(const std::string& s) { return *this << std::string_view(s); }
+
+		Line& operator<<(char c)
+		{
+			if (on)
+				scratch().push_back(c);
+			return *this;
+		}
+
+		template <typename T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, char> && !std::is_same_v<T, bool>, int> = 0>
+		Line& operator<<(T v)
+		{
+			return number(v, 10);
+		}
+
+		Line& operator<<(Hex h) { return number(h.value, 16); }
+
+	private:
+		template <typename T>
+		Line& number(T v, int base)
+		{
+			if (on)
+			{
+				char buf[24];
+				auto res = std::to_chars(buf, buf + sizeof(buf), v, base);
+				scratch().append(buf, res.ptr);
+			}
+			return *this;
+		}
+
+		// shared by nested lines on one thread: each only owns what was appended after start
+		static std::string& scratch()
+		{
+			thread_local std::string text;
+			return text;
+		}
+
+		Level level;
+		bool on;
+		size_t start;
+	};
+
+	inline Line error() { return Line(Level::error); }
+	inline Line warning() { return Line(Level::warning); }
+	inline Line info() { return Line(Level::info); }
+	inline Line verbose() { return Line(Level::verbose); }
+	inline Line debug() { return Line(Level::debug); }
+}
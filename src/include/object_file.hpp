@@ -0,0 +1,24 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include "types.hpp"
+#include "binary_io.hpp"
+#include "zone_writer.hpp"
+
+// Relocatable output of `linker --compile`: zone bytes for one or more assets, serialized as if
+// they started at an aligned offset 0 of their blocks, plus what the final link needs to place
+// them. String pooling only spans a single object.
+struct ZoneObject
+{
+	std::vector<XAssetType> types;
+	std::array<size_t, MAX_XFILE_COUNT> blocks = {};
+	std::vector<std::string> script_strings;
+	std::vector<ZoneRelocation> relocations;
+	std::vector<unsigned char> data;
+};
+
+void write_zone_object(const ZoneObject& obj, std::vector<unsigned char>& out);
+bool read_zone_object(binary_io::ByteSpan in, ZoneObject& obj);
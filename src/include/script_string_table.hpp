@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Zone-wide script string list. Assets refer to script strings by their 16-bit index, and each
+// distinct string is stored once; interning is a single hash lookup so large tables stay linear.
+class ScriptStringTable
+{
+public:
+	// false once the 16-bit index space is used up
+	bool intern(std::string_view str, std::uint16_t& index)
+	{
+		auto found = indices.find(str);
+		if (found != indices.end())
+		{
+			index = found->second;
+			return true;
+		}
+
+		if (strings.size() > 0xFFFF)
+			return false;
+
+		// deque elements never move, so the map can key on views of them
+		strings.emplace_back(str);
+		index = static_cast<std::uint16_t>(strings.size() - 1);
+		indices.emplace(strings.back(), index);
+		return true;
+	}
+
+	size_t size() const { return strings.size(); }
+	const std::deque<std::string>& all() const { return strings; }
+
+private:
+	std::deque<std::string> strings;
+	std::unordered_map<std::string_view, std::uint16_t> indices;
+};
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <string_view>
 
 using u32 = std::uint32_t;
 using u16 = std::uint16_t;
@@ -12,30 +14,54 @@ struct LocalizeEntry
 	const char* name;
 };
 
+// Every LOCALIZE_ENTRY of one .str, loaded as a single asset and written as count LocalizeEntry
+// records. Entry i is the i-th name in names (NUL-terminated, back to back) with
+// values[i * languages + language]; a null value leaves it out of that language's zone, which then
+// has present[language] records.
+struct LocalizeGroup
+{
+	std::uint32_t count;
+	std::uint32_t languages;
+	const char* names;
+	const char* const* values;
+	const std::uint32_t* present;
+};
+
 struct RawFile
 {
 	const char* name;
+	int compressedLen;
 	int len;
 	const char* buffer;
 };
 
+// game layout of one cell; see StringTable
 struct StringTableCell
 {
 	const char* string;
 	int hash;
 };
 
+// The game stores rowCount * columnCount StringTableCells, each string on its own. The linker keeps
+// the table columnar instead and serialize_string_table() writes the game layout from it: cell i is
+// text[offsets[i], offsets[i + 1] - 1), every cell is NUL-terminated, and hashes[i] is its hash.
+// Streamed tables (LinkOptions::stream_tables_over) have no text or offsets, only hashes; their
+// cells are read again from source, the mapped csv, while serializing.
 struct StringTable
 {
 	const char* name;
 	int columnCount;
 	int rowCount;
-	StringTableCell* values;
+	const char* text;
+	const std::uint32_t* offsets;   // rowCount * columnCount + 1 entries
+	const int* hashes;
+	std::string_view source;
 };
 
 union XAssetHeader
 {
 	LocalizeEntry* localize;
+	LocalizeGroup* localize_group;    // linker side; see LocalizeGroup
 	RawFile* rawfile;
 	StringTable* stringtable;
 
@@ -97,6 +123,9 @@ constexpr int XFILE_BLOCK_LARGE = 0x3;
 constexpr int XFILE_BLOCK_PHYSICAL = 0x4;
 constexpr int MAX_XFILE_COUNT = 0x6;
 
+// largest inflated zone, and largest inflated rawfile, the unlinker accepts
+constexpr std::size_t MAX_UNLINK_SIZE = 50 * 1024 * 1024;
+
 struct XZoneMemory
 {
 	u32 size;
@@ -2,8 +2,18 @@
 
 #include <string>
 #include <cctype>
+#include <cstdint>
 #include <cstring>
 #include <filesystem>
+#include <string_view>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define UTIL_SSE2 1
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
 
 namespace util
 {
@@ -39,4 +49,93 @@ namespace util
 	{
 		return (buf[pos] << 24) | (buf[pos + 1] << 16) | (buf[pos + 2] << 8) | buf[pos + 3];
 	}
+
+	// std::getline over an in-memory buffer: splits on '\n' (a trailing '\r' is kept),
+	// the last line may lack a newline, and no empty line is produced after a final '\n'
+	inline bool next_line(std::string_view buf, size_t& pos, std::string_view& line)
+	{
+		if (pos >= buf.size())
+			return false;
+
+		size_t end = buf.find('\n', pos);
+		if (end == std::string_view::npos)
+		{
+			line = buf.substr(pos);
+			pos = buf.size();
+		}
+		else
+		{
+			line = buf.substr(pos, end - pos);
+			pos = end + 1;
+		}
+		return true;
+	}
+
+#ifdef UTIL_SSE2
+	// index of the lowest set bit of a non-zero movemask
+	inline unsigned lowest_bit(unsigned mask)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return index;
+#else
+		return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+	}
+#endif
+
+	// First of a, b or c in [p, end), or end. Compares 16 bytes at a time where SSE2 is available,
+	// which is what keeps CSV and .str scanning close to memory speed.
+	inline const char* find_any_of(const char* p, const char* end, char a, char b, char c)
+	{
+#ifdef UTIL_SSE2
+		const __m128i va = _mm_set1_epi8(a);
+		const __m128i vb = _mm_set1_epi8(b);
+		const __m128i vc = _mm_set1_epi8(c);
+		while (end - p >= 16)
+		{
+			__m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+			__m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, va), _mm_cmpeq_epi8(chunk, vb)), _mm_cmpeq_epi8(chunk, vc));
+			unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hits));
+			if (mask != 0)
+				return p + lowest_bit(mask);
+			p += 16;
+		}
+#endif
+		for (; p < end; p++)
+		{
+			if (*p == a || *p == b || *p == c)
+				return p;
+		}
+		return end;
+	}
+
+	// First backslash, double quote or control character (below 0x20) in [p, end), or end: every
+	// byte a quoted string may need to escape. Callers check the byte they stop at.
+	inline const char* find_escapable(const char* p, const char* end)
+	{
+#ifdef UTIL_SSE2
+		const __m128i backslash = _mm_set1_epi8('\\');
+		const __m128i quote = _mm_set1_epi8('"');
+		const __m128i control_max = _mm_set1_epi8(0x1F);
+		while (end - p >= 16)
+		{
+			__m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+			__m128i control = _mm_cmpeq_epi8(_mm_max_epu8(chunk, control_max), control_max);
+			__m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, backslash), _mm_cmpeq_epi8(chunk, quote)), control);
+			unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hits));
+			if (mask != 0)
+				return p + lowest_bit(mask);
+			p += 16;
+		}
+#endif
+		for (; p < end; p++)
+		{
+			unsigned char c = static_cast<unsigned char>(*p);
+			if (c == '\\' || c == '"' || c < 0x20)
+				return p;
+		}
+		return end;
+	}
 }
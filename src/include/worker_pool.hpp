@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.hpp"
+
+// Fixed set of threads running submitted tasks. A task returns false to mark the whole batch failed.
+// finish() waits for everything submitted so far; the pool takes no new work after that.
+class WorkerPool
+{
+public:
+	explicit WorkerPool(unsigned threads) : tasks(threads * 4)
+	{
+		for (unsigned i = 0; i < (threads ? threads : 1); i++)
+			workers.emplace_back(&WorkerPool::run, this);
+	}
+
+	~WorkerPool() { finish(); }
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	bool submit(std::function<bool()> task)
+	{
+		return !failed && tasks.push(std::move(task));
+	}
+
+	bool finish()
+	{
+		tasks.close();
+		for (auto& t : workers)
+			t.join();
+		workers.clear();
+		return !failed;
+	}
+
+private:
+	void run()
+	{
+		std::function<bool()> task;
+		while (tasks.pop(task))
+		{
+			if (!failed && !task())
+				failed = true;
+		}
+	}
+
+	BoundedQueue<std::function<bool()>> tasks;
+	std::vector<std::thread> workers;
+	std::atomic<bool> failed{false};
+};
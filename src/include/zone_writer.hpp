@@ -0,0 +1,123 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "types.hpp"
+
+// A field a relocatable object (.ffo) must patch when it is placed in a zone.
+struct ZoneRelocation
+{
+	enum class Kind : std::uint32_t
+	{
+		block_pointer = 0,  // be32 zone pointer into the object, rebased to where the object lands
+		script_string = 1,  // be16 index into the object's script strings, mapped onto the zone's table
+	};
+
+	Kind kind;
+	size_t offset;
+};
+
+// Growable in-memory byte stream the zone is serialized into (big-endian, like the game expects).
+// It also tracks how much memory the game needs in each XFILE block to load what was written:
+// bytes land in the current block, and align() mirrors the game rounding a block position up
+// before it loads a struct or array there.
+class ZoneWriter
+{
+public:
+	void write(const void* data, size_t len)
+	{
+		const auto* p = static_cast<const unsigned char*>(data);
+		buf.insert(buf.end(), p, p + len);
+		blocks[block] += len;
+	}
+
+	// grows the stream by len bytes of the current block and returns them for the caller to fill in
+	unsigned char* grow(size_t len)
+	{
+		size_t at = buf.size();
+		buf.resize(at + len);
+		blocks[block] += len;
+		return buf.data() + at;
+	}
+
+	void set_block(int index) { block = index; }
+	void align(size_t alignment) { blocks[block] = (blocks[block] + alignment - 1) & ~(alignment - 1); }
+	const std::array<size_t, MAX_XFILE_COUNT>& block_sizes() const { return blocks; }
+
+	// zone pointer the game resolves to the next byte of the current block
+	std::uint32_t next_pointer() const
+	{
+		return ((static_cast<std::uint32_t>(block) << 28) | static_cast<std::uint32_t>(blocks[block])) + 1;
+	}
+
+	void write_be32(std::uint32_t val)
+	{
+		unsigned char be[4] = {
+			static_cast<unsigned char>(val >> 24), static_cast<unsigned char>(val >> 16),
+			static_cast<unsigned char>(val >> 8), static_cast<unsigned char>(val)};
+		write(be, sizeof(be));
+	}
+
+	void write_be16(std::uint16_t val)
+	{
+		unsigned char be[2] = {static_cast<unsigned char>(val >> 8), static_cast<unsigned char>(val)};
+		write(be, sizeof(be));
+	}
+
+	// zone pointer field; back-references are recorded as relocations when that is switched on
+	void write_pointer(std::uint32_t ptr)
+	{
+		if (recording && ptr != 0 && ptr != 0xFFFFFFFF && ptr != 0xFFFFFFFE)
+			relocs.push_back({ZoneRelocation::Kind::block_pointer, buf.size()});
+		write_be32(ptr);
+	}
+
+	void write_script_string(std::uint16_t index)
+	{
+		if (recording)
+			relocs.push_back({ZoneRelocation::Kind::script_string, buf.size()});
+		write_be16(index);
+	}
+
+	void write_string(std::string_view str)
+	{
+		write(str.data(), str.size());
+		buf.push_back('\0');
+		blocks[block] += 1;
+	}
+
+	void reserve(size_t len) { buf.reserve(len); }
+	size_t size() const { return buf.size(); }
+	const unsigned char* data() const { return buf.data(); }
+	std::vector<unsigned char>& bytes() { return buf; }
+
+	// bytes serialized elsewhere from an aligned start, with the block memory they needed there
+	void append(const void* data, size_t len, const std::array<size_t, MAX_XFILE_COUNT>& used)
+	{
+		const auto* p = static_cast<const unsigned char*>(data);
+		buf.insert(buf.end(), p, p + len);
+		for (int i = 0; i < MAX_XFILE_COUNT; i++)
+			blocks[i] += used[i];
+	}
+
+	void record_relocations(bool on) { recording = on; }
+	const std::vector<ZoneRelocation>& relocations() const { return relocs; }
+
+	// hands over the bytes written so far; block accounting carries on from where it was
+	std::vector<unsigned char> take()
+	{
+		std::vector<unsigned char> out = std::move(buf);
+		buf.clear();
+		return out;
+	}
+
+private:
+	std::vector<unsigned char> buf;
+	std::array<size_t, MAX_XFILE_COUNT> blocks = {};
+	int block = XFILE_BLOCK_TEMP;
+	bool recording = false;
+	std::vector<ZoneRelocation> relocs;
+};
@@ -0,0 +1,312 @@
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "input_source.hpp"
+#include "binary_io.hpp"
+#include "logging.hpp"
+#include "miniz.h"
+#include "xxhash64.hpp"
+
+namespace
+{
+    // read-only mapping of a whole file, released with the object
+    class MappedFile
+    {
+    public:
+        MappedFile() = default;
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        ~MappedFile()
+        {
+            if (!view)
+                return;
+#ifdef _WIN32
+            UnmapViewOfFile(view);
+#else
+            munmap(view, length);
+#endif
+        }
+
+        bool open(const std::filesystem::path& file)
+        {
+#ifdef _WIN32
+            HANDLE handle = CreateFileW(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (handle == INVALID_HANDLE_VALUE)
+                return false;
+
+            LARGE_INTEGER size;
+            bool ok = GetFileSizeEx(handle, &size) != 0;
+            length = ok ? static_cast<size_t>(size.QuadPart) : 0;
+            if (ok && length > 0)
+            {
+                HANDLE mapping = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                if (mapping)
+                {
+                    view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                    CloseHandle(mapping);
+                }
+                ok = view != nullptr;
+            }
+            CloseHandle(handle);
+            return ok;
+#else
+            int fd = ::open(file.c_str(), O_RDONLY);
+            if (fd < 0)
+                return false;
+
+            struct stat st;
+            bool ok = fstat(fd, &st) == 0;
+            length = ok ? static_cast<size_t>(st.st_size) : 0;
+            if (ok && length > 0)
+            {
+                void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                ok = p != MAP_FAILED;
+                if (ok)
+                    view = p;
+            }
+            close(fd);
+            return ok;
+#endif
+        }
+
+        std::string_view bytes() const
+        {
+            return view ? std::string_view(static_cast<const char*>(view), length) : std::string_view();
+        }
+
+    private:
+        void* view = nullptr;
+        size_t length = 0;
+    };
+}
+
+bool InputSource::map(const std::string& path, std::string_view& out, std::shared_ptr<void>& owner)
+{
+    auto buffer = std::make_shared<std::string>();
+    if (!read(path, *buffer))
+        return false;
+
+    out = *buffer;
+    owner = buffer;
+    return true;
+}
+
+bool FilesystemSource::read(const std::string& path, std::string& out)
+{
+    std::ifstream file(describe(path), std::ios::binary | std::ios::ate);
+    if (!file.is_open())
+        return false;
+
+    size_t filesize = static_cast<size_t>(file.tellg());
+    file.seekg(0, std::ios::beg);
+
+    out.resize(filesize);
+    if (filesize > 0 && !file.read(&out[0], filesize))
+        return false;
+    return true;
+}
+
+std::string FilesystemSource::describe(const std::string& path) const
+{
+    return root + "/" + path;
+}
+
+bool FilesystemSource::map(const std::string& path, std::string_view& out, std::shared_ptr<void>& owner)
+{
+    auto mapped = std::make_shared<MappedFile>();
+    if (!mapped->open(std::filesystem::path(describe(path))))
+        return false;
+
+    out = mapped->bytes();
+    owner = mapped;
+    return true;
+}
+
+std::string ZipSource::normalize(const std::string& path)
+{
+    std::string out = path;
+    for (char& c : out)
+    {
+        if (c == '\\')
+            c = '/';
+        else
+            c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    return out;
+}
+
+struct ZipSource::Reader
+{
+    mz_zip_archive zip = {};
+
+    ~Reader() { mz_zip_reader_end(&zip); }
+};
+
+ZipSource::ZipSource(const std::string& zippath) : zippath(zippath)
+{
+}
+
+ZipSource::~ZipSource() = default;
+
+bool ZipSource::open(const std::string& modname)
+{
+    archive = binary_io::read_file_to_memory(zippath);
+    if (archive.empty())
+    {
+        logging::error() << "Failed to open archive: " << zippath;
+        return false;
+    }
+
+    auto reader = std::make_unique<Reader>();
+    if (!mz_zip_reader_init_mem(&reader->zip, archive.data(), archive.size(), 0))
+    {
+        logging::error() << "Failed to read archive: " << zippath << ": " << mz_zip_get_error_string(mz_zip_get_last_error(&reader->zip));
+        return false;
+    }
+
+    mz_uint count = mz_zip_reader_get_num_files(&reader->zip);
+    for (mz_uint i = 0; i < count; i++)
+    {
+        mz_zip_archive_file_stat stat;
+        if (!mz_zip_reader_file_stat(&reader->zip, i, &stat) || stat.m_is_directory)
+            continue;
+
+        auto member = std::make_unique<Member>();
+        member->index = i;
+        member->size = static_cast<size_t>(stat.m_uncomp_size);
+        members.emplace(normalize(stat.m_filename), std::move(member));
+    }
+    readers.push_back(std::move(reader));
+
+    // accept both a bare mod tree and one wrapped in a top-level <modname>/ folder
+    std::string csv = "zone_source/" + modname + ".csv";
+    if (members.find(normalize(csv)) == members.end() && members.find(normalize(modname + "/" + csv)) != members.end())
+        prefix = modname + "/";
+
+    return true;
+}
+
+ZipSource::Member* ZipSource::find(const std::string& path) const
+{
+    auto it = members.find(normalize(prefix + path));
+    return it == members.end() ? nullptr : it->second.get();
+}
+
+// Borrows an idle reader, or sets up another one for this thread, so members inflate in parallel.
+bool ZipSource::inflate(const std::string& path, const Member& member, char* out)
+{
+    std::unique_ptr<Reader> reader;
+    {
+        std::lock_guard<std::mutex> guard(readers_lock);
+        if (!readers.empty())
+        {
+            reader = std::move(readers.back());
+            readers.pop_back();
+        }
+    }
+    if (!reader)
+    {
+        reader = std::make_unique<Reader>();
+        if (!mz_zip_reader_init_mem(&reader->zip, archive.data(), archive.size(), 0))
+        {
+            logging::error() << "Failed to read archive: " << zippath;
+            return false;
+        }
+    }
+
+    bool ok = member.size == 0 || mz_zip_reader_extract_to_mem(&reader->zip, member.index, out, member.size, 0);
+    {
+        std::lock_guard<std::mutex> guard(readers_lock);
+        readers.push_back(std::move(reader));
+    }
+
+    if (!ok)
+        logging::error() << "Failed to inflate " << describe(path);
+    return ok;
+}
+
+bool ZipSource::read(const std::string& path, std::string& out)
+{
+    Member* member = find(path);
+    if (!member)
+        return false;
+
+    out.resize(member->size);
+    return inflate(path, *member, out.empty() ? nullptr : &out[0]);
+}
+
+bool ZipSource::map(const std::string& path, std::string_view& out, std::shared_ptr<void>& owner)
+{
+    Member* member = find(path);
+    if (!member)
+        return false;
+
+    std::call_once(member->inflated, [&]
+    {
+        member->contents.resize(member->size);
+        member->ok = inflate(path, *member, member->contents.empty() ? nullptr : &member->contents[0]);
+    });
+    if (!member->ok)
+        return false;
+
+    out = member->contents;
+    owner.reset();
+    return true;
+}
+
+std::string ZipSource::describe(const std::string& path) const
+{
+    return zippath + ":" + prefix + path;
+}
+
+bool RecordingSource::read(const std::string& path, std::string& out)
+{
+    bool found = inner.read(path, out);
+    record(path, found, out);
+    return found;
+}
+
+bool RecordingSource::map(const std::string& path, std::string_view& out, std::shared_ptr<void>& owner)
+{
+    bool found = inner.map(path, out, owner);
+    record(path, found, out);
+    return found;
+}
+
+void RecordingSource::record(const std::string& path, bool found, std::string_view data)
+{
+    // hashed here, on the loader thread that did the read
+    std::uint64_t digest = found ? xxhash::xxh64(data.data(), data.size()) : 0;
+    std::string f = found ? inner.file(path) : std::string();
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (found)
+        read_files.insert(std::move(f));
+    read_paths[path] = {found, digest};
+}
+
+std::vector<std::string> RecordingSource::files() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return std::vector<std::string>(read_files.begin(), read_files.end());
+}
+
+std::map<std::string, RecordingSource::Read> RecordingSource::reads() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return read_paths;
+}
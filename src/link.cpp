@@ -0,0 +1,656 @@
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "types.hpp"
+#include "util.hpp"
+#include "logging.hpp"
+#include "compression.hpp"
+#include "assets.hpp"
+#include "zone_writer.hpp"
+#include "fftools.hpp"
+#include "bounded_queue.hpp"
+#include "object_file.hpp"
+
+static XAssetType asset_type_for_string(const std::string& type_str)
+{
+	if (type_str == "localize")
+		return XAssetType::LOCALIZE_ENTRY;
+	if (type_str == "rawfile")
+		return XAssetType::RAWFILE;
+	if (type_str == "stringtable")
+		return XAssetType::STRINGTABLE;
+	return static_cast<XAssetType>(-1);
+}
+
+static void write_zone_memory_header(ZoneWriter& zw, const XZoneMemory& mem)
+{
+	zw.write_be32(mem.size);
+	zw.write_be32(mem.externalsize);
+	for (int i = 0; i < MAX_XFILE_COUNT; i++)
+		zw.write_be32(mem.streams[i]);
+}
+
+static void write_xassetlist(ZoneWriter& zw, const XAssetList& list, const ScriptStringTable& script_strings, const std::vector<XAssetType>& types)
+{
+	zw.align(4);
+	zw.write_be32(list.scriptStringCount);
+	zw.write_be32(list.scriptStrings);
+	zw.write_be32(list.assetCount);
+	zw.write_be32(list.assets);
+
+	zw.align(4);
+	for (std::uint32_t i = 0; i < list.scriptStringCount; ++i)
+		zw.write_be32(0xFFFFFFFF);
+
+	for (const std::string& str : script_strings.all())
+		zw.write_string(str);
+
+	zw.align(4);
+	for (XAssetType type : types)
+	{
+		zw.write_be32(static_cast<std::uint32_t>(type));
+		zw.write_be32(0xFFFFFFFF);
+	}
+}
+
+// Per-block memory the game reserves for the zone: what the asset list and the asset data
+// need in each XFILE block, rounded to 4 bytes. size covers everything after this header.
+static int compute_zone_memory(const ZoneWriter& asset_list, const ZoneWriter& body, size_t body_len, size_t block_limit, XZoneMemory& mem)
+{
+	static const char* block_names[MAX_XFILE_COUNT] = {"temp", "runtime", "virtual", "large", "physical", "block 5"};
+	const size_t u32_max = 0xFFFFFFFF;
+
+	size_t total = asset_list.size() + body_len;
+	if (total > u32_max)
+	{
+		logging::error() << "Zone is too large: " << total << " bytes";
+		return 1;
+	}
+
+	mem = {};
+	mem.size = static_cast<u32>(total);
+	mem.externalsize = 0;
+	for (int i = 0; i < MAX_XFILE_COUNT; i++)
+	{
+		size_t needed = (asset_list.block_sizes()[i] + body.block_sizes()[i] + 3) & ~static_cast<size_t>(3);
+		if (needed > u32_max)
+		{
+			logging::error() << "XFILE " << block_names[i] << " block is too large: " << needed << " bytes";
+			return 1;
+		}
+		if (block_limit > 0 && needed > block_limit)
+			logging::warning() << "Warning: XFILE " << block_names[i] << " block needs " << needed << " bytes, over the " << block_limit << " byte limit";
+		mem.streams[i] = static_cast<u32>(needed);
+	}
+
+	return 0;
+}
+
+static void write_fastfile_header(ZoneWriter& fout)
+{
+	// write magic
+	const char iw4_magic[8] = {'I','W','f','f','u','1','0','0'};
+	fout.write(iw4_magic, sizeof(iw4_magic));
+
+	// version
+	fout.write_be32(0x000000FD);
+
+	// timestamps / region
+	fout.write_be32(0x00000000);
+	fout.write_be32(0x00000000);
+	fout.write_be32(0x00000000);
+
+	// not setting this make the dlc language mismatch?
+	fout.write_be32(0x01000000);
+
+	// unknown
+	fout.write_be32(0x000000F5);
+	fout.write_be32(0xEF0000F5);
+
+	// 0xEF cuz idk?
+	unsigned char stray = 0xEF;
+	fout.write(&stray, 1);
+}
+
+struct ManifestEntry
+{
+	XAssetType type;
+	const AssetHandler* handler;
+	std::string path;
+};
+
+static int parse_csv(std::string_view manifest, std::vector<ManifestEntry>& entries)
+{
+	std::string_view view;
+	size_t line_pos = 0;
+	while (util::next_line(manifest, line_pos, view))
+	{
+		std::string line(view);
+		line.erase(remove_if(line.begin(), line.end(), [](unsigned char c) { return std::isspace(c); }),
+		           line.end());
+
+		if (line.empty())
+			continue;
+
+		size_t comma_pos = line.find(',');
+		if (comma_pos == std::string::npos)
+			continue;
+
+		std::string asset_type_str = line.substr(0, comma_pos);
+		std::string asset_path = line.substr(comma_pos + 1);
+
+		logging::verbose() << asset_type_str << ", " << asset_path;
+
+		XAssetType type = asset_type_for_string(asset_type_str);
+		if (type == static_cast<XAssetType>(-1))
+		{
+			logging::error() << "Unsupported asset type: " << asset_type_str;
+			return 1;
+		}
+
+		const AssetHandler* handler = find_asset_handler(type);
+		if (!handler)
+		{
+			logging::error() << "Invalid asset type: " << asset_type_str;
+			return 1;
+		}
+
+		entries.push_back({type, handler, asset_path});
+	}
+
+	return 0;
+}
+
+// Compressor stage and zone framing, shared by manifest links and object links. The caller
+// appends the zone body to body() and calls flush() between assets; a thread deflates full
+// chunks as they come. The zone prologue (XZoneMemory and the asset list) depends on every
+// asset, so finish() deflates it last as a separate piece and puts it in front of the body.
+class ZoneAssembler
+{
+public:
+	ZoneAssembler(LinkContext& ctx, bool keep_zone) : ctx(ctx), keep_zone(keep_zone), chunks(8)
+	{
+		body_writer.set_block(XFILE_BLOCK_LARGE);
+		compressor = std::thread(&ZoneAssembler::compress_worker, this);
+	}
+
+	~ZoneAssembler() { stop(); }
+
+	ZoneWriter& body() { return body_writer; }
+	void add_asset(XAssetType type, size_t records = 1) { types.insert(types.end(), records, type); }
+
+	// hands the body written so far to the compressor once it fills a chunk (or always, if final)
+	bool flush(bool final = false)
+	{
+		const size_t chunk_size = 256 * 1024;
+		if (body_writer.size() == 0 || (!final && body_writer.size() < chunk_size))
+			return true;
+		body_len += body_writer.size();
+		return chunks.push(body_writer.take());
+	}
+
+	int finish(std::vector<unsigned char>& ff, std::vector<unsigned char>& raw)
+	{
+		if (!flush(true))
+			return 1;
+		stop();
+
+		if (compress_failed)
+		{
+			logging::error() << "Compression failed";
+			return 1;
+		}
+
+		XAssetList list = {};
+		list.scriptStringCount = static_cast<u32>(ctx.script_strings.size());
+		list.scriptStrings = list.scriptStringCount > 0 ? 0xFFFFFFFF : 0;
+		list.assetCount = static_cast<u32>(types.size());
+		list.assets = 0xFFFFFFFF;
+
+		ZoneWriter asset_list;
+		asset_list.set_block(XFILE_BLOCK_TEMP);
+		write_xassetlist(asset_list, list, ctx.script_strings, types);
+
+		XZoneMemory zone_memory;
+		if (compute_zone_memory(asset_list, body_writer, body_len, ctx.options.block_limit, zone_memory) > 0)
+			return 1;
+
+		ZoneWriter prologue;
+		prologue.reserve(asset_list.size() + 32);
+		write_zone_memory_header(prologue, zone_memory);
+		prologue.write(asset_list.data(), asset_list.size());
+
+		compression::RawDeflater head;
+		std::vector<unsigned char> head_out;
+		if (!head.deflate(prologue.data(), prologue.size(), MZ_SYNC_FLUSH, head_out))
+		{
+			logging::error() << "Compression failed";
+			return 1;
+		}
+
+		ZoneWriter fout;
+		fout.reserve(head_out.size() + body_out.size() + 64);
+		write_fastfile_header(fout);
+
+		std::vector<unsigned char>& out = fout.bytes();
+		compression::zlib_header(out);
+		out.insert(out.end(), head_out.begin(), head_out.end());
+		out.insert(out.end(), body_out.begin(), body_out.end());
+		compression::zlib_trailer(out, compression::adler32_combine(head.checksum(), deflater.checksum(), deflater.consumed()));
+		ff = std::move(out);
+
+		raw.clear();
+		if (keep_zone)
+		{
+			raw = std::move(prologue.bytes());
+			raw.insert(raw.end(), raw_body.begin(), raw_body.end());
+		}
+
+		return 0;
+	}
+
+private:
+	void stop()
+	{
+		chunks.close();
+		if (compressor.joinable())
+			compressor.join();
+	}
+
+	void compress_worker()
+	{
+		std::vector<unsigned char> bytes;
+		while (chunks.pop(bytes))
+		{
+			if (keep_zone)
+				raw_body.insert(raw_body.end(), bytes.begin(), bytes.end());
+			if (!deflater.deflate(bytes.data(), bytes.size(), MZ_NO_FLUSH, body_out))
+				compress_failed = true;
+		}
+
+		if (!deflater.deflate(nullptr, 0, MZ_FINISH, body_out))
+			compress_failed = true;
+	}
+
+	LinkContext& ctx;
+	bool keep_zone;
+
+	std::vector<XAssetType> types;
+	ZoneWriter body_writer;
+	size_t body_len = 0;
+	BoundedQueue<std::vector<unsigned char>> chunks;
+	std::thread compressor;
+
+	compression::RawDeflater deflater;
+	std::vector<unsigned char> body_out;
+	std::vector<unsigned char> raw_body;
+	std::atomic<bool> compress_failed{false};
+};
+
+// XAsset list records an asset expands to in a language's zone; a localize group has one per entry
+// with a value in that language
+static size_t asset_records(const Asset& asset, size_t language)
+{
+	return asset.type == XAssetType::LOCALIZE_ENTRY ? asset.header.localize_group->present[language] : 1;
+}
+
+// Serializes ctx's assets as if placed at offset 0 of the large block, leaving their zone pointers
+// and script strings relocatable; append_object() rebases them into a zone.
+static int serialize_object(LinkContext& ctx, ZoneObject& obj)
+{
+	ZoneWriter zw;
+	zw.set_block(XFILE_BLOCK_LARGE);
+	zw.record_relocations(true);
+
+	for (const auto& asset : ctx.assets)
+	{
+		obj.types.insert(obj.types.end(), asset_records(*asset, ctx.language), asset->type);
+		if (find_asset_handler(asset->type)->serialize(ctx, zw, asset->header) > 0)
+			return 1;
+	}
+
+	obj.blocks = zw.block_sizes();
+	obj.script_strings.assign(ctx.script_strings.all().begin(), ctx.script_strings.all().end());
+	obj.relocations = zw.relocations();
+	obj.data = zw.take();
+	return 0;
+}
+
+// Places a compiled object at the next aligned position of the zone body, rebasing its zone
+// pointers and mapping its script string indices onto the zone's table.
+static int append_object(LinkContext& ctx, ZoneObject& obj, ZoneAssembler& zone)
+{
+	const std::uint32_t offset_mask = 0x0FFFFFFF;
+
+	ZoneWriter& body = zone.body();
+	body.align(4);
+	const auto& base = body.block_sizes();
+
+	for (const ZoneRelocation& reloc : obj.relocations)
+	{
+		size_t at = reloc.offset;
+		if (reloc.kind == ZoneRelocation::Kind::block_pointer)
+		{
+			if (at + 4 > obj.data.size())
+				return 1;
+			std::uint32_t ptr = util::read_be32(obj.data.data(), at);
+
+			std::uint32_t block = (ptr - 1) >> 28;
+			size_t offset = ((ptr - 1) & offset_mask) + (block < MAX_XFILE_COUNT ? base[block] : 0);
+			if (block >= MAX_XFILE_COUNT || offset > offset_mask)
+			{
+				logging::error() << "Zone pointer out of range";
+				return 1;
+			}
+
+			ptr = ((block << 28) | static_cast<std::uint32_t>(offset)) + 1;
+			obj.data[at] = static_cast<unsigned char>(ptr >> 24);
+			obj.data[at + 1] = static_cast<unsigned char>(ptr >> 16);
+			obj.data[at + 2] = static_cast<unsigned char>(ptr >> 8);
+			obj.data[at + 3] = static_cast<unsigned char>(ptr);
+		}
+		else
+		{
+			if (at + 2 > obj.data.size())
+				return 1;
+			std::uint16_t local = static_cast<std::uint16_t>((obj.data[at] << 8) | obj.data[at + 1]);
+
+			std::uint16_t index = 0;
+			if (local >= obj.script_strings.size() || !ctx.script_strings.intern(obj.script_strings[local], index))
+			{
+				logging::error() << "Invalid script string reference";
+				return 1;
+			}
+
+			obj.data[at] = static_cast<unsigned char>(index >> 8);
+			obj.data[at + 1] = static_cast<unsigned char>(index);
+		}
+	}
+
+	body.append(obj.data.data(), obj.data.size(), obj.blocks);
+	for (XAssetType type : obj.types)
+		zone.add_asset(type);
+
+	return zone.flush() ? 0 : 1;
+}
+
+// Loader threads load manifest entries, each into its own context, at most `window` entries
+// ahead of the calling thread, which serializes them in manifest order into the assemblers,
+// one per language.
+class LinkPipeline
+{
+public:
+	LinkPipeline(LinkContext& ctx, const std::vector<ManifestEntry>& entries, unsigned threads,
+	             std::vector<std::unique_ptr<ZoneAssembler>>& zones)
+		: ctx(ctx), entries(entries), slots(entries.size()), loaders(threads ? threads : 1),
+		  window(static_cast<size_t>(loaders) * 2), zones(zones), language_pools(zones.size())
+	{
+	}
+
+	int run()
+	{
+		std::vector<std::thread> threads;
+		for (unsigned i = 0; i < loaders; i++)
+			threads.emplace_back(&LinkPipeline::load_worker, this);
+
+		int result = serialize_all();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			aborted = result != 0;
+		}
+		window_moved.notify_all();
+
+		for (auto& t : threads)
+			t.join();
+
+		return result;
+	}
+
+private:
+	struct LoadSlot
+	{
+		std::unique_ptr<LinkContext> ctx;
+		int result = 0;
+		bool done = false;
+	};
+
+	void load_worker()
+	{
+		for (;;)
+		{
+			size_t idx;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				window_moved.wait(lock, [&] { return aborted || next_entry >= entries.size() || next_entry < serialized + window; });
+				if (aborted || next_entry >= entries.size())
+					return;
+				idx = next_entry++;
+			}
+
+			const ManifestEntry& entry = entries[idx];
+			auto slot_ctx = std::make_unique<LinkContext>(ctx.name, ctx.input, ctx.options);
+			int result = entry.handler->load(*slot_ctx, entry.type, entry.path);
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				slots[idx].ctx = std::move(slot_ctx);
+				slots[idx].result = result;
+				slots[idx].done = true;
+			}
+			slot_ready.notify_all();
+		}
+	}
+
+	int serialize_all()
+	{
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			std::unique_ptr<LinkContext> loaded;
+			int result;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				slot_ready.wait(lock, [&] { return slots[i].done; });
+				loaded = std::move(slots[i].ctx);
+				result = slots[i].result;
+				serialized = i + 1;
+			}
+			window_moved.notify_all();
+
+			if (result > 0)
+			{
+				logging::error() << "Error loading asset: " << entries[i].path;
+				return 1;
+			}
+
+			if (zones.size() == 1)
+				result = serialize_direct(*loaded);
+			else if (entries[i].type == XAssetType::LOCALIZE_ENTRY)
+				result = serialize_localized(*loaded);
+			else
+				result = serialize_shared(*loaded);
+			if (result > 0)
+				return 1;
+		}
+
+		return 0;
+	}
+
+	int serialize_direct(const LinkContext& loaded)
+	{
+		ZoneAssembler& zone = *zones[0];
+		for (const auto& asset : loaded.assets)
+		{
+			zone.add_asset(asset->type, asset_records(*asset, 0));
+			if (find_asset_handler(asset->type)->serialize(ctx, zone.body(), asset->header) > 0)
+				return 1;
+		}
+
+		return zone.flush() ? 0 : 1;
+	}
+
+	// Localize entries are all that differs between languages, so they go into each zone directly,
+	// pooled only against that language's strings.
+	int serialize_localized(const LinkContext& loaded)
+	{
+		for (size_t language = 0; language < zones.size(); language++)
+		{
+			ZoneAssembler& zone = *zones[language];
+			ctx.language = language;
+			std::swap(ctx.string_pool, language_pools[language]);
+
+			int result = 0;
+			for (const auto& asset : loaded.assets)
+			{
+				zone.add_asset(asset->type, asset_records(*asset, language));
+				if (find_asset_handler(asset->type)->serialize(ctx, zone.body(), asset->header) > 0)
+				{
+					result = 1;
+					break;
+				}
+			}
+
+			std::swap(ctx.string_pool, language_pools[language]);
+			ctx.language = 0;
+			if (result > 0 || !zone.flush())
+				return 1;
+		}
+
+		return 0;
+	}
+
+	// Everything else is serialized once, in its own context, and the object is placed in every zone.
+	int serialize_shared(LinkContext& loaded)
+	{
+		ZoneObject obj;
+		if (serialize_object(loaded, obj) > 0)
+			return 1;
+
+		for (auto& zone : zones)
+		{
+			ZoneObject placed = obj;
+			if (append_object(ctx, placed, *zone) > 0)
+				return 1;
+		}
+
+		return 0;
+	}
+
+	LinkContext& ctx;
+	const std::vector<ManifestEntry>& entries;
+	std::vector<LoadSlot> slots;
+	unsigned loaders;
+	size_t window;
+	std::vector<std::unique_ptr<ZoneAssembler>>& zones;
+	std::vector<std::unordered_map<std::string_view, std::uint32_t>> language_pools;
+
+	std::mutex mutex;
+	std::condition_variable slot_ready;
+	std::condition_variable window_moved;
+	size_t next_entry = 0;
+	size_t serialized = 0;
+	bool aborted = false;
+};
+
+namespace fftools
+{
+	Linker::Linker(const std::string& name, InputSource& input, const LinkOptions& options)
+		: name(name), input(input), options(options), raw(1)
+	{
+	}
+
+	int Linker::link(std::string_view manifest, std::vector<unsigned char>& ff)
+	{
+		std::vector<std::vector<unsigned char>> ffs;
+		if (link_zones(manifest, 1, ffs) > 0)
+			return 1;
+		ff = std::move(ffs[0]);
+		return 0;
+	}
+
+	int Linker::link_languages(std::string_view manifest, std::vector<std::vector<unsigned char>>& ffs)
+	{
+		return link_zones(manifest, std::max<size_t>(1, options.languages.size()), ffs);
+	}
+
+	// Each assembler deflates on its own thread, so the languages are compressed in parallel.
+	int Linker::link_zones(std::string_view manifest, size_t languages, std::vector<std::vector<unsigned char>>& ffs)
+	{
+		std::vector<ManifestEntry> entries;
+		if (parse_csv(manifest, entries) > 0)
+			return 1;
+
+		unsigned threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+
+		LinkContext ctx(name, input, options);
+		std::vector<std::unique_ptr<ZoneAssembler>> zones;
+		for (size_t i = 0; i < languages; i++)
+			zones.push_back(std::make_unique<ZoneAssembler>(ctx, options.keep_zone));
+
+		LinkPipeline pipeline(ctx, entries, threads, zones);
+		if (pipeline.run() > 0)
+			return 1;
+
+		ffs.assign(languages, {});
+		raw.assign(languages, {});
+		for (size_t i = 0; i < languages; i++)
+		{
+			if (zones[i]->finish(ffs[i], raw[i]) > 0)
+				return 1;
+		}
+		return 0;
+	}
+
+	int Linker::compile(std::string_view entries_text, std::vector<unsigned char>& object)
+	{
+		std::vector<ManifestEntry> entries;
+		if (parse_csv(entries_text, entries) > 0)
+			return 1;
+
+		LinkContext ctx(name, input, options);
+		for (const ManifestEntry& entry : entries)
+		{
+			if (entry.handler->load(ctx, entry.type, entry.path) > 0)
+			{
+				logging::error() << "Error loading asset: " << entry.path;
+				return 1;
+			}
+		}
+
+		ZoneObject obj;
+		if (serialize_object(ctx, obj) > 0)
+			return 1;
+
+		write_zone_object(obj, object);
+		return 0;
+	}
+
+	int Linker::link_objects(const std::vector<binary_io::ByteSpan>& objects, std::vector<unsigned char>& ff)
+	{
+		LinkContext ctx(name, input, options);
+		ZoneAssembler zone(ctx, options.keep_zone);
+
+		for (size_t i = 0; i < objects.size(); i++)
+		{
+			ZoneObject obj;
+			if (!read_zone_object(objects[i], obj))
+			{
+				logging::error() << "Invalid object file (#" << i + 1 << ")";
+				return 1;
+			}
+			if (append_object(ctx, obj, zone) > 0)
+				return 1;
+		}
+
+		raw.assign(1, {});
+		return zone.finish(ff, raw[0]);
+	}
+}
@@ -1,243 +1,216 @@
-#include <iostream>
 #include <fstream>
-#include <sstream>
 #include <string>
 #include <vector>
-#include <cstring>
 #include <memory>
-#include <cstdint>
-#include <algorithm>
 #include <filesystem>
+#include <cstdlib>
+#include <cstdio>
+#include <cctype>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <thread>
 
-#include "types.hpp"
-#include "util.hpp"
-#include "binary_io.hpp"
-#include "compression.hpp"
-#include "assets.hpp"
+#include "fftools.hpp"
+#include "logging.hpp"
+#include "xxhash64.hpp"
 
 namespace fs = std::filesystem;
 
 #define APP_VERSION "0.1.0"
 
-XAssetType asset_type_for_string(const std::string& type_str)
-{
-	if (type_str == "localize")
-		return XAssetType::LOCALIZE_ENTRY;
-	if (type_str == "rawfile")
-		return XAssetType::RAWFILE;
-	if (type_str == "stringtable")
-		return XAssetType::STRINGTABLE;
-	return static_cast<XAssetType>(-1);
-}
-void init_asset_handlers_impl()
-{
-	asset_handlers[static_cast<int>(XAssetType::LOCALIZE_ENTRY)] = {load_localize_entry, serialize_localize_entry, extract_localize_entry};
-	asset_handlers[static_cast<int>(XAssetType::RAWFILE)] = {load_raw_file, serialize_raw_file, extract_raw_file};
-	asset_handlers[static_cast<int>(XAssetType::STRINGTABLE)] = {load_string_table, serialize_string_table, extract_string_table};
-}
-
-void write_zone_memory_header(std::ofstream& fp, const XZoneMemory& mem)
-{
-	binary_io::write_be32(fp, mem.size);
-	binary_io::write_be32(fp, mem.externalsize);
-	for (int i = 0; i < MAX_XFILE_COUNT; i++)
-		binary_io::write_be32(fp, mem.streams[i]);
-}
-
-void write_xassetlist(std::ofstream& fp, const XAssetList& list)
+static int write_file(const std::string& filename, const std::vector<unsigned char>& data)
 {
-	const size_t static_size = 5000000;
-	XZoneMemory zone_memory = {static_size, 0, {static_size, 0, 0, static_size, 0, 0}};
-	write_zone_memory_header(fp, zone_memory);
-
-	binary_io::write_be32(fp, list.scriptStringCount);
-	binary_io::write_be32(fp, list.scriptStrings);
-	binary_io::write_be32(fp, list.assetCount);
-	binary_io::write_be32(fp, list.assets);
-
-	for (std::uint32_t i = 0; i < list.scriptStringCount; ++i)
-		binary_io::write_be32(fp, 0xFFFFFFFF);
-
-	for (std::uint32_t i = 0; i < list.scriptStringCount; ++i)
-		binary_io::write_string(fp, "");
-
-	auto it = assets;
-	while (it)
+	std::ofstream fout(filename, std::ios::binary);
+	if (!fout.is_open())
 	{
-		binary_io::write_be32(fp, static_cast<std::uint32_t>(it->type));
-		binary_io::write_be32(fp, 0xFFFFFFFF);
-		it = it->next;
+		logging::error() << "Failed to open output file: " << filename;
+		return 1;
 	}
+
+	fout.write(reinterpret_cast<const char*>(data.data()), data.size());
+	fout.close();
+	return fout.fail() ? 1 : 0;
 }
 
-int write_fastfile_raw(const std::string& output_filename)
+// Makefile-style "targets: deps" rule, as read by make and ninja's depfile support
+static int write_depfile(const std::string& filename, const std::vector<std::string>& targets, const std::vector<std::string>& deps)
 {
-	std::ofstream fp(output_filename, std::ios::binary);
-	if (!fp.is_open())
+	auto escape = [](const std::string& path)
 	{
-		std::cerr << "Failed to open output file: " << output_filename << std::endl;
-		return 1;
-	}
-
-	int numassets = 0;
-	auto it = assets;
-	while (it)
-	{
-		numassets++;
-		it = it->next;
-	}
-
-	std::string basename = fs::path(output_filename).stem().string();
-
-	XAssetList list = {};
-	list.scriptStringCount = 0;
-	list.scriptStrings = 0;
-	list.assetCount = numassets;
-	list.assets = 0xFFFFFFFF;
-
-	write_xassetlist(fp, list);
+		std::string out;
+		for (char c : path)
+		{
+			if (c == '\\')
+				c = '/';
+			if (c == ' ' || c == '#')
+				out += '\\';
+			else if (c == '$')
+				out += '$';
+			out += c;
+		}
+		return out;
+	};
 
-	it = assets;
-	while (it)
+	std::ofstream fout(filename, std::ios::binary);
+	if (!fout.is_open())
 	{
-		asset_handlers[static_cast<int>(it->type)].serialize(fp, *it->header);
-		it = it->next;
+		logging::error() << "Failed to open depfile: " << filename;
+		return 1;
 	}
 
-	fp.close();
-	return 0;
+	for (size_t i = 0; i < targets.size(); i++)
+		fout << (i ? " " : "") << escape(targets[i]);
+	fout << ":";
+	for (const std::string& dep : deps)
+		fout << " \\\n  " << escape(dep);
+	fout << "\n";
+	fout.close();
+	return fout.fail() ? 1 : 0;
 }
 
-int write_fastfile(const std::string& input_filename, const std::string& output_filename)
+// Link settings that change the output bytes, hashed along with the inputs.
+static std::string fingerprint_key(const fftools::LinkOptions& options, bool make_ffm)
 {
-	std::ifstream fin(input_filename, std::ios::binary);
-	if (!fin.is_open())
-	{
-		std::cerr << "Failed to open raw file: " << input_filename << std::endl;
-		return 1;
-	}
-
-	fin.seekg(0, std::ios::end);
-	size_t filesize = fin.tellg();
-	fin.seekg(0, std::ios::beg);
-
-	std::vector<unsigned char> input_data(filesize);
-	fin.read(reinterpret_cast<char*>(input_data.data()), filesize);
-	fin.close();
+	std::string languages;
+	for (const std::string& language : options.languages)
+		languages += " " + language;
+	return std::string(APP_VERSION) + (make_ffm ? " ffm" : " ff") + " k" + std::to_string(options.keep_zone) +
+		" c" + std::to_string(options.compress_rawfiles) + ":" + std::to_string(options.compress_min_size) +
+		" p" + std::to_string(options.pool_strings) + " b" + std::to_string(options.block_limit) + languages + "\n";
+}
 
-	auto compressed_data = compression::compress_data(input_data.data(), filesize);
-	if (compressed_data.empty())
+static std::uint64_t fingerprint(const std::string& key, const std::map<std::string, RecordingSource::Read>& reads)
+{
+	std::string record = key;
+	for (const auto& [path, read] : reads)
 	{
-		std::cerr << "Compression failed" << std::endl;
-		return 1;
+		record += path;
+		record += '\0';
+		record += read.found ? '1' : '0';
+		for (int i = 0; i < 8; i++)
+			record += static_cast<char>(read.digest >> (i * 8));
 	}
+	return xxhash::xxh64(record.data(), record.size());
+}
 
-	std::ofstream fout(output_filename, std::ios::binary);
+// the fingerprint on the first line, then every input path it covers
+static int write_fingerprint(const std::string& filename, const std::string& key, const std::map<std::string, RecordingSource::Read>& reads)
+{
+	std::ofstream fout(filename, std::ios::binary);
 	if (!fout.is_open())
 	{
-		std::cerr << "Failed to open output file: " << output_filename << std::endl;
+		logging::error() << "Failed to open fingerprint file: " << filename;
 		return 1;
 	}
 
-	// write magic
-	const char iw4_magic[8] = {'I','W','f','f','u','1','0','0'};
-	fout.write(iw4_magic, sizeof(iw4_magic));
-
-	// version
-	binary_io::write_be32(fout, 0x000000FD);
-
-	// timestamps / region
-	binary_io::write_be32(fout, 0x00000000);
-	binary_io::write_be32(fout, 0x00000000);
-	binary_io::write_be32(fout, 0x00000000);
-
-	// not setting this make the dlc language mismatch?
-	binary_io::write_be32(fout, 0x01000000);
-
-	// unknown
-	binary_io::write_be32(fout, 0x000000F5);
-	binary_io::write_be32(fout, 0xEF0000F5);
-
-	// 0xEF cuz idk?
-	unsigned char stray = 0xEF;
-	fout.write(reinterpret_cast<const char*>(&stray), 1);
-
-	fout.write(reinterpret_cast<const char*>(compressed_data.data()), compressed_data.size());
+	char hex[17];
+	std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(fingerprint(key, reads)));
+	fout << hex << "\n";
+	for (const auto& entry : reads)
+		fout << entry.first << "\n";
 	fout.close();
-
-	return 0;
+	return fout.fail() ? 1 : 0;
 }
 
-int parse_csv(const std::string& basename, const std::string& csv)
+// true when the inputs listed in the fingerprint file still hash to its fingerprint; they are read
+// and hashed again on several threads, which is far cheaper than loading and serializing them
+static bool up_to_date(const std::string& filename, const std::string& key, InputSource& input, unsigned threads)
 {
-	std::ifstream fp(csv);
-	if (!fp.is_open())
-	{
-		std::cerr << "Failed to open CSV: " << csv << std::endl;
-		return 1;
-	}
+	std::ifstream fin(filename, std::ios::binary);
+	if (!fin.is_open())
+		return false;
 
 	std::string line;
-	while (std::getline(fp, line))
-	{
-		line.erase(remove_if(line.begin(), line.end(), [](unsigned char c) { return std::isspace(c); }),
-		           line.end());
+	if (!std::getline(fin, line))
+		return false;
+	std::uint64_t stored = std::strtoull(line.c_str(), nullptr, 16);
 
-		if (line.empty())
-			continue;
-
-		size_t comma_pos = line.find(',');
-		if (comma_pos == std::string::npos)
-			continue;
-
-		std::string asset_type_str = line.substr(0, comma_pos);
-		std::string asset_path = line.substr(comma_pos + 1);
-
-		std::cout << asset_type_str << ", " << asset_path << std::endl;
-
-		XAssetType type = asset_type_for_string(asset_type_str);
-		if (type == static_cast<XAssetType>(-1))
-		{
-			std::cerr << "Unsupported asset type: " << asset_type_str << std::endl;
-			return 1;
-		}
-
-		int handler_idx = static_cast<int>(type);
-		if (handler_idx < 0 || handler_idx >= static_cast<int>(XAssetType::ASSETLIST))
-		{
-			std::cerr << "Invalid asset type: " << asset_type_str << std::endl;
-			return 1;
-		}
+	std::vector<std::string> paths;
+	while (std::getline(fin, line))
+	{
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		if (!line.empty())
+			paths.push_back(line);
+	}
+	if (paths.empty())
+		return false;
 
-		if (asset_handlers[handler_idx].load(type, basename, asset_path) > 0)
+	std::vector<RecordingSource::Read> results(paths.size());
+	std::atomic<size_t> next{0};
+	auto hash_inputs = [&]()
+	{
+		std::string buffer;
+		for (size_t i = next++; i < paths.size(); i = next++)
 		{
-			std::cerr << "Error loading asset: " << asset_path << std::endl;
-			return 1;
+			if (input.read(paths[i], buffer))
+				results[i] = {true, xxhash::xxh64(buffer.data(), buffer.size())};
+			else
+				results[i] = {false, 0};
 		}
-	}
-
-	fp.close();
-	return 0;
+	};
+
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	unsigned workers = static_cast<unsigned>(std::min<size_t>(threads, paths.size()));
+	std::vector<std::thread> pool;
+	for (unsigned i = 1; i < workers; i++)
+		pool.emplace_back(hash_inputs);
+	hash_inputs();
+	for (auto& t : pool)
+		t.join();
+
+	std::map<std::string, RecordingSource::Read> reads;
+	for (size_t i = 0; i < paths.size(); i++)
+		reads.emplace(paths[i], results[i]);
+	return fingerprint(key, reads) == stored;
 }
 
 void print_banner()
 {
-	std::cout << "fastfile - compiler / linker v" << APP_VERSION << " for MW2" << std::endl;
+	logging::info() << "fastfile - compiler / linker v" << APP_VERSION << " for MW2";
+}
+
+static void print_usage(const char* argv0)
+{
+	logging::error() << "Usage: " << argv0 << " [-q|-v|-vv] [-m] [-k] [-c] [-p] [-f] [-j <threads>] [--from <mod.zip>] [--stream-tables <MiB>] [--cache <dir>] [--languages <a,b,...>] [--depfile <file.d>] <modname>";
+	logging::error() << "       " << argv0 << " [-c] [-p] [--from <mod.zip>] --compile <type>,<path> [-o <out.ffo>] [--depfile <file.d>] <modname>";
+	logging::error() << "       " << argv0 << " [-m] [-k] [--depfile <file.d>] --link <modname> <a.ffo> [b.ffo ...]";
+	logging::error() << "  -m: produce .ffm; default: .ff";
+	logging::error() << "  -k: keep .ffraw";
+	logging::error() << "  -c: compress rawfiles";
+	logging::error() << "  -p: pool repeated strings";
+	logging::error() << "  -j: asset loader threads";
+	logging::error() << "  --from: read the mod tree from a zip";
+	logging::error() << "  --cache: keep parsed .str files in this directory and reuse them while unchanged";
+	logging::error() << "  --stream-tables: stream stringtables over this many MiB from the file instead of loading them (default 64, 0: never)";
+	logging::error() << "  --languages: build one zone per language, as <language>/<modname>.ff";
+	logging::error() << "  --compile: serialize one manifest entry into an object file";
+	logging::error() << "  --link: build the fastfile from object files, in the order given";
+	logging::error() << "  -q / -v / -vv: only warnings and errors / one line per asset / everything, e.g. every localize string";
+	logging::error() << "  -f: relink even when the inputs match the last link's fingerprint";
+	logging::error() << "  --depfile: also write a Makefile-style list of every file the output was built from";
 }
 
 int main(int argc, char** argv)
 {
-	print_banner();
-	init_asset_handlers();
 	if (argc < 2)
 	{
-		std::cerr << "Usage: " << argv[0] << " [-m] [-k] <modname>    (-m: produce .ffm; default: .ff; -k: keep .ffraw)" << std::endl;
+		print_banner();
+		print_usage(argv[0]);
 		return 1;
 	}
 
 	bool make_ffm = false;
-	bool keep_raw = false;
-	std::string name;
+	bool link_objects = false;
+	bool force = false;
+	fftools::LinkOptions options;
+	std::string from_zip;
+	std::string compile_entry;
+	std::string object_out;
+	std::string depfile;
+	std::vector<std::string> positional;
 
 	for (int i = 1; i < argc; ++i)
 	{
@@ -248,77 +221,289 @@ int main(int argc, char** argv)
 		}
 		else if (a == "-k")
 		{
-			keep_raw = true;
+			options.keep_zone = true;
+		}
+		else if (a == "-c")
+		{
+			options.compress_rawfiles = true;
+		}
+		else if (a == "-p")
+		{
+			options.pool_strings = true;
+		}
+		else if (a == "-f")
+		{
+			force = true;
+		}
+		else if (a == "-q")
+		{
+			logging::set_level(logging::Level::warning);
+		}
+		else if (a == "-v")
+		{
+			logging::set_level(logging::Level::verbose);
+		}
+		else if (a == "-vv")
+		{
+			logging::set_level(logging::Level::debug);
+		}
+		else if (a == "-j" && i + 1 < argc)
+		{
+			options.threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+		}
+		else if (a == "--stream-tables" && i + 1 < argc)
+		{
+			options.stream_tables_over = static_cast<size_t>(std::strtoull(argv[++i], nullptr, 10)) * 1024 * 1024;
+		}
+		else if (a == "--cache" && i + 1 < argc)
+		{
+			options.cache_dir = argv[++i];
+		}
+		else if (a == "--languages" && i + 1 < argc)
+		{
+			std::string list = argv[++i];
+			for (size_t start = 0; start <= list.size();)
+			{
+				size_t end = std::min(list.find(',', start), list.size());
+				std::string language = list.substr(start, end - start);
+				std::transform(language.begin(), language.end(), language.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+				if (!language.empty() && std::find(options.languages.begin(), options.languages.end(), language) == options.languages.end())
+					options.languages.push_back(language);
+				start = end + 1;
+			}
+		}
+		else if (a == "--from" && i + 1 < argc)
+		{
+			from_zip = argv[++i];
+		}
+		else if (a == "--compile" && i + 1 < argc)
+		{
+			compile_entry = argv[++i];
+		}
+		else if (a == "-o" && i + 1 < argc)
+		{
+			object_out = argv[++i];
+		}
+		else if (a == "--depfile" && i + 1 < argc)
+		{
+			depfile = argv[++i];
+		}
+		else if (a == "--link")
+		{
+			link_objects = true;
 		}
 		else if (!a.empty() && a[0] == '-')
 		{
-			std::cerr << "Unknown option: " << a << std::endl;
-			std::cerr << "Usage: " << argv[0] << " [-m] [-k] <modname>    (-m: produce .ffm; default: .ff; -k: keep .ffraw)" << std::endl;
+			logging::error() << "Unknown option: " << a;
+			print_usage(argv[0]);
 			return 1;
 		}
 		else
 		{
-			if (name.empty())
-				name = fs::path(a).stem().string();
-			else
-			{
-				std::cerr << "Unexpected argument: " << a << std::endl;
-				std::cerr << "Usage: " << argv[0] << " [-m] [-k] <modname>    (-m: produce .ffm; default: .ff; -k: keep .ffraw)" << std::endl;
-				return 1;
-			}
+			positional.push_back(a);
 		}
 	}
 
-	if (name.empty())
+	print_banner();
+
+	bool compile = !compile_entry.empty();
+	bool languages = !options.languages.empty();
+	if (positional.empty() || (compile && link_objects) || (languages && (compile || link_objects)) ||
+		(link_objects ? positional.size() < 2 : positional.size() > 1))
 	{
-		std::cerr << "Usage: " << argv[0] << " [-m] [-k] <modname>    (-m: produce .ffm; default: .ff; -k: keep .ffraw)" << std::endl;
+		if (positional.size() > 1 && !link_objects)
+			logging::error() << "Unexpected argument: " << positional[1];
+		print_usage(argv[0]);
 		return 1;
 	}
 
-	fs::path csv_path = fs::path(name) / "zone_source" / (name + ".csv");
-	std::string csv = csv_path.string();
+	std::string name = fs::path(positional[0]).stem().string();
 
 	std::string basename = name;
 
-	std::cout << "Loading CSV: " << csv << std::endl;
+	// with --languages, one zone per language in <language>/, like the game's zone/<language> folders
+	std::vector<std::string> outputs;
+	if (!languages)
+		outputs.push_back(basename);
+	for (const std::string& language : options.languages)
+		outputs.push_back((fs::path(language) / basename).string());
+
+	std::string extension = make_ffm ? ".ffm" : ".ff";
+	std::vector<std::string> ff_outs;
+	for (const std::string& output : outputs)
+		ff_outs.push_back(output + extension);
+
+	std::string fingerprint_file = ff_outs[0] + ".fp";
+	std::string key = fingerprint_key(options, make_ffm);
+
+	// with --from, the archive file as a whole is the one fingerprinted input, so a link that is
+	// up to date never opens it
+	fs::path archive_path(from_zip);
+	std::string archive_name = archive_path.filename().string();
+	FilesystemSource fingerprinted(from_zip.empty() ? name : archive_path.has_parent_path() ? archive_path.parent_path().string() : ".");
+	if (!from_zip.empty())
+		key += "from " + from_zip + "\n";
+
+	if (!compile && !link_objects && !force)
+	{
+		bool outputs_exist = depfile.empty() || fs::exists(depfile);
+		for (const std::string& output : outputs)
+			outputs_exist = outputs_exist && fs::exists(output + extension) && (!options.keep_zone || fs::exists(output + ".ffraw"));
+		if (outputs_exist && up_to_date(fingerprint_file, key, fingerprinted, options.threads))
+		{
+			for (const std::string& ff_out : ff_outs)
+				logging::info() << "Up to date: " << ff_out;
+			return 0;
+		}
+	}
 
-	if (parse_csv(basename, csv) > 0)
+	std::unique_ptr<InputSource> input;
+	ZipSource* zip_input = nullptr;
+	if (from_zip.empty())
 	{
-		std::cerr << "Failed to read CSV: " << csv << std::endl;
-		return 1;
+		input = std::make_unique<FilesystemSource>(name);
+	}
+	else
+	{
+		logging::info() << "Reading mod tree from archive: " << from_zip;
+		auto zip = std::make_unique<ZipSource>(from_zip);
+		if (!zip->open(name))
+			return 1;
+		zip_input = zip.get();
+		input = std::move(zip);
 	}
 
-	std::string ffraw = basename + ".ffraw";
-	std::cout << "Writing raw file: " << ffraw << std::endl;
+	// every file the handlers open goes through here, so the depfile lists exactly what was read
+	RecordingSource recorded(*input);
 
-	if (write_fastfile_raw(ffraw) > 0)
+	fftools::Linker linker(basename, recorded, options);
+
+	if (compile)
 	{
-		std::cerr << "Failed to write raw file" << std::endl;
-		return 1;
+		if (object_out.empty())
+		{
+			std::string path = compile_entry.substr(compile_entry.find(',') + 1);
+			for (char& c : path)
+				if (c == '/' || c == '\\')
+					c = '_';
+			object_out = path + ".ffo";
+		}
+
+		std::vector<unsigned char> object;
+		if (linker.compile(compile_entry, object) > 0)
+		{
+			logging::error() << "Failed to compile: " << compile_entry;
+			return 1;
+		}
+
+		logging::info() << "Writing object: " << object_out;
+		if (write_file(object_out, object) > 0)
+		{
+			logging::error() << "Failed to write object file";
+			return 1;
+		}
+		if (!depfile.empty() && write_depfile(depfile, {object_out}, recorded.files()) > 0)
+			return 1;
+		return 0;
 	}
 
-	std::string out_ext = make_ffm ? ".ffm" : ".ff";
-	std::string ff_out = basename + out_ext;
-	std::cout << "Compressing and writing: " << ff_out << std::endl;
+	std::vector<std::vector<unsigned char>> ffs(1);
+	std::vector<std::string> deps;
+	if (link_objects)
+	{
+		deps.assign(positional.begin() + 1, positional.end());
+
+		std::vector<std::string> objects;
+		std::vector<binary_io::ByteSpan> spans;
+		for (size_t i = 1; i < positional.size(); i++)
+		{
+			logging::verbose() << "Loading object: " << positional[i];
+			objects.push_back(binary_io::read_file_to_memory(positional[i]));
+			if (objects.back().empty())
+			{
+				logging::error() << "Failed to read object file: " << positional[i];
+				return 1;
+			}
+		}
+		for (const std::string& object : objects)
+			spans.push_back(binary_io::as_bytes(object));
 
-	if (write_fastfile(ffraw, ff_out) > 0)
+		if (linker.link_objects(spans, ffs[0]) > 0)
+		{
+			logging::error() << "Failed to link objects";
+			return 1;
+		}
+	}
+	else
 	{
-		std::cerr << "Failed to write fastfile" << std::endl;
-		return 1;
+		std::string csv = "zone_source/" + name + ".csv";
+
+		logging::info() << "Loading CSV: " << input->describe(csv);
+
+		std::string manifest;
+		if (!recorded.read(csv, manifest))
+		{
+			logging::error() << "Failed to open CSV: " << input->describe(csv);
+			return 1;
+		}
+
+		if (linker.link_languages(manifest, ffs) > 0)
+		{
+			logging::error() << "Failed to link: " << input->describe(csv);
+			return 1;
+		}
+		deps = recorded.files();
 	}
-	std::cout << "Successfully wrote: " << ff_out << std::endl;
 
-	if (!keep_raw)
+	// the outputs are about to change; a stale fingerprint must not outlive them
+	std::error_code ec;
+	fs::remove(fingerprint_file, ec);
+
+	for (size_t i = 0; i < outputs.size(); i++)
 	{
-		std::error_code ec;
-		if (fs::remove(ffraw, ec))
+		fs::path parent = fs::path(outputs[i]).parent_path();
+		if (!parent.empty())
+			fs::create_directories(parent, ec);
+
+		if (options.keep_zone)
 		{
-			std::cout << "Removed temporary file: " << ffraw << std::endl;
+			std::string ffraw = outputs[i] + ".ffraw";
+			logging::info() << "Writing raw file: " << ffraw;
+
+			if (write_file(ffraw, linker.zone(i)) > 0)
+			{
+				logging::error() << "Failed to write raw file";
+				return 1;
+			}
 		}
-		else if (ec)
+
+		logging::info() << "Writing fastfile: " << ff_outs[i];
+
+		if (write_file(ff_outs[i], ffs[i]) > 0)
 		{
-			std::cerr << "Warning: failed to remove temporary file " << ffraw << ": " << ec.message() << std::endl;
+			logging::error() << "Failed to write fastfile";
+			return 1;
 		}
+		logging::info() << "Successfully wrote: " << ff_outs[i];
+	}
+
+	if (!depfile.empty())
+	{
+		logging::info() << "Writing depfile: " << depfile;
+		if (write_depfile(depfile, ff_outs, deps) > 0)
+			return 1;
 	}
+
+	auto reads = recorded.reads();
+	if (zip_input)
+	{
+		std::string_view archive = zip_input->contents();
+		reads = {{archive_name, {true, xxhash::xxh64(archive.data(), archive.size())}}};
+	}
+
+	// objects carry no record of their sources, so only a link from the manifest is fingerprinted
+	if (!link_objects && write_fingerprint(fingerprint_file, key, reads) > 0)
+		logging::warning() << "Warning: no fingerprint written; the next link will not be skipped";
+
 	return 0;
 }
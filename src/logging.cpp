@@ -0,0 +1,203 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "logging.hpp"
+
+namespace logging
+{
+    static std::atomic<Level> current_level{Level::info};
+
+    void set_level(Level l)
+    {
+        current_level.store(l, std::memory_order_relaxed);
+    }
+
+    Level level()
+    {
+        return current_level.load(std::memory_order_relaxed);
+    }
+
+    // Single-producer ring of finished lines: the owning thread appends, the writer drains under
+    // the logger's mutex. head and tail only grow; positions wrap modulo the capacity.
+    struct ThreadBuffer
+    {
+        static const size_t capacity = 64 * 1024;
+
+        std::unique_ptr<char[]> data{new char[capacity]};
+        std::atomic<size_t> head{0};
+        std::atomic<size_t> tail{0};
+
+        ThreadBuffer();
+        ~ThreadBuffer();
+
+        bool try_push(std::string_view text)
+        {
+            size_t t = tail.load(std::memory_order_relaxed);
+            if (capacity - (t - head.load(std::memory_order_acquire)) < text.size() + 1)
+                return false;
+
+            for (char c : text)
+                data[t++ % capacity] = c;
+            data[t++ % capacity] = '\n';
+            tail.store(t, std::memory_order_release);
+            return true;
+        }
+
+        void drain(std::string& out)
+        {
+            size_t h = head.load(std::memory_order_relaxed);
+            size_t t = tail.load(std::memory_order_acquire);
+            while (h < t)
+            {
+                size_t at = h % capacity;
+                size_t run = std::min(t - h, capacity - at);
+                out.append(data.get() + at, run);
+                h += run;
+            }
+            head.store(h, std::memory_order_release);
+        }
+    };
+
+    // Owns the registered buffers and the thread that writes them out. Lines are in order per thread;
+    // lines of different threads are interleaved as they are drained.
+    class Logger
+    {
+    public:
+        Logger() : writer(&Logger::run, this) {}
+
+        ~Logger()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_one();
+            writer.join();
+            flush();
+        }
+
+        void add(ThreadBuffer* buffer)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            buffers.push_back(buffer);
+        }
+
+        void remove(ThreadBuffer* buffer)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            write_pending();
+            buffers.erase(std::find(buffers.begin(), buffers.end(), buffer));
+        }
+
+        void request_drain()
+        {
+            wake.notify_one();
+        }
+
+        void flush()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            write_pending();
+        }
+
+        // writes everything logged so far, then text, while no buffer can be drained in between
+        void write_now(std::FILE* stream, std::string_view text)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            write_pending();
+            std::fwrite(text.data(), 1, text.size(), stream);
+            std::fputc('\n', stream);
+            std::fflush(stream);
+        }
+
+    private:
+        // mutex held
+        void write_pending()
+        {
+            pending.clear();
+            for (ThreadBuffer* buffer : buffers)
+                buffer->drain(pending);
+            if (!pending.empty())
+            {
+                std::fwrite(pending.data(), 1, pending.size(), stdout);
+                std::fflush(stdout);
+            }
+        }
+
+        void run()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!stopping)
+            {
+                wake.wait_for(lock, std::chrono::milliseconds(50));
+                write_pending();
+            }
+        }
+
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::vector<ThreadBuffer*> buffers;
+        std::string pending;
+        bool stopping = false;
+        std::thread writer;
+    };
+
+    static Logger& logger()
+    {
+        static Logger instance;
+        return instance;
+    }
+
+    ThreadBuffer::ThreadBuffer()
+    {
+        logger().add(this);
+    }
+
+    ThreadBuffer::~ThreadBuffer()
+    {
+        logger().remove(this);
+    }
+
+    static ThreadBuffer& thread_buffer()
+    {
+        thread_local ThreadBuffer buffer;
+        return buffer;
+    }
+
+    void flush()
+    {
+        logger().flush();
+    }
+
+    void write(Level l, std::string_view text)
+    {
+        if (l <= Level::warning)
+        {
+            logger().write_now(stderr, text);
+            return;
+        }
+
+        // a line that could never fit is written directly, still after everything before it
+        ThreadBuffer& buffer = thread_buffer();
+        if (text.size() >= ThreadBuffer::capacity / 2)
+        {
+            logger().write_now(stdout, text);
+            return;
+        }
+
+        while (!buffer.try_push(text))
+        {
+            logger().request_drain();
+            std::this_thread::yield();
+        }
+        if (buffer.tail.load(std::memory_order_relaxed) - buffer.head.load(std::memory_order_relaxed) > ThreadBuffer::capacity / 2)
+            logger().request_drain();
+    }
+}
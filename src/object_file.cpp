@@ -0,0 +1,99 @@
+#include <cstring>
+
+#include "object_file.hpp"
+
+// .ffo layout, big-endian like the zone:
+//   magic "IWffo001"
+//   u32 asset count, u32 type per asset
+//   u32 block size per XFILE block
+//   u32 script string count, NUL-terminated strings
+//   u32 relocation count, u32 kind + u32 offset per relocation
+//   u32 data length, data
+static const char ffo_magic[8] = {'I','W','f','f','o','0','0','1'};
+
+void write_zone_object(const ZoneObject& obj, std::vector<unsigned char>& out)
+{
+    ZoneWriter w;
+    w.reserve(obj.data.size() + obj.relocations.size() * 8 + 256);
+    w.write(ffo_magic, sizeof(ffo_magic));
+
+    w.write_be32(static_cast<std::uint32_t>(obj.types.size()));
+    for (XAssetType type : obj.types)
+        w.write_be32(static_cast<std::uint32_t>(type));
+
+    for (size_t size : obj.blocks)
+        w.write_be32(static_cast<std::uint32_t>(size));
+
+    w.write_be32(static_cast<std::uint32_t>(obj.script_strings.size()));
+    for (const std::string& str : obj.script_strings)
+        w.write_string(str);
+
+    w.write_be32(static_cast<std::uint32_t>(obj.relocations.size()));
+    for (const ZoneRelocation& reloc : obj.relocations)
+    {
+        w.write_be32(static_cast<std::uint32_t>(reloc.kind));
+        w.write_be32(static_cast<std::uint32_t>(reloc.offset));
+    }
+
+    w.write_be32(static_cast<std::uint32_t>(obj.data.size()));
+    w.write(obj.data.data(), obj.data.size());
+
+    out = w.take();
+}
+
+bool read_zone_object(binary_io::ByteSpan in, ZoneObject& obj)
+{
+    size_t pos = 0;
+    binary_io::ByteSpan magic;
+    if (!in.read_bytes(pos, sizeof(ffo_magic), magic) || std::memcmp(magic.data(), ffo_magic, sizeof(ffo_magic)) != 0)
+        return false;
+
+    std::uint32_t count = 0;
+    if (!in.read_be32(pos, count) || count > in.size() / 4)
+        return false;
+    obj.types.resize(count);
+    for (auto& type : obj.types)
+    {
+        std::uint32_t val = 0;
+        if (!in.read_be32(pos, val) || val >= static_cast<std::uint32_t>(XAssetType::ASSETLIST))
+            return false;
+        type = static_cast<XAssetType>(val);
+    }
+
+    for (auto& size : obj.blocks)
+    {
+        std::uint32_t val = 0;
+        if (!in.read_be32(pos, val))
+            return false;
+        size = val;
+    }
+
+    if (!in.read_be32(pos, count) || count > in.size())
+        return false;
+    obj.script_strings.resize(count);
+    for (auto& str : obj.script_strings)
+    {
+        std::string_view view;
+        if (!in.read_string(pos, view))
+            return false;
+        str = view;
+    }
+
+    if (!in.read_be32(pos, count) || count > in.size() / 8)
+        return false;
+    obj.relocations.resize(count);
+    for (auto& reloc : obj.relocations)
+    {
+        std::uint32_t kind = 0, offset = 0;
+        if (!in.read_be32(pos, kind) || !in.read_be32(pos, offset) || kind > 1)
+            return false;
+        reloc.kind = static_cast<ZoneRelocation::Kind>(kind);
+        reloc.offset = offset;
+    }
+
+    binary_io::ByteSpan data;
+    if (!in.read_be32(pos, count) || !in.read_bytes(pos, count, data))
+        return false;
+    obj.data.assign(data.data(), data.data() + data.size());
+    return true;
+}
@@ -0,0 +1,585 @@
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#include "types.hpp"
+#include "util.hpp"
+#include "logging.hpp"
+#include "binary_io.hpp"
+#include "compression.hpp"
+#include "assets.hpp"
+#include "fftools.hpp"
+#include "bounded_queue.hpp"
+#include "worker_pool.hpp"
+
+struct ff_header
+{
+	std::uint32_t padding = 0;
+	std::uint32_t size_a = 0;
+	std::uint32_t size_b = 0;
+	std::uint32_t region = 0;
+	std::uint32_t bool1 = 0;
+};
+
+static size_t find_zlib_header(const unsigned char* data, size_t len)
+{
+	for (size_t i = 0; i + 1 < len; ++i)
+	{
+		if (data[i] == 0x78 && (data[i + 1] == 0x01 || data[i + 1] == 0x9C || data[i + 1] == 0xDA))
+			return i;
+	}
+	return SIZE_MAX;
+}
+
+static size_t find_zlib_header_from(const unsigned char* data, size_t len, size_t start)
+{
+	if (start >= len) return SIZE_MAX;
+	for (size_t i = start; i + 1 < len; ++i)
+	{
+		if (data[i] == 0x78 && (data[i + 1] == 0x01 || data[i + 1] == 0x9C || data[i + 1] == 0xDA))
+			return i;
+	}
+	return SIZE_MAX;
+}
+
+static bool read_prefix(const unsigned char* data, size_t len, ff_header& out, size_t& prefix_end)
+{
+	const unsigned char iw4_magic[] = {'I','W','f','f','u','1','0','0'};
+	if (len < sizeof(iw4_magic)) return false;
+	if (std::memcmp(data, iw4_magic, sizeof(iw4_magic)) != 0) return false;
+
+	(void)out;
+	prefix_end = std::min<size_t>(len, 0x1C);
+	return true;
+}
+
+static const char* XAssetTypeToString(std::uint32_t t)
+{
+	using X = XAssetType;
+	switch (static_cast<X>(t))
+	{
+	case X::LOCALIZE_ENTRY: return "LOCALIZE_ENTRY";
+	case X::RAWFILE: return "RAWFILE";
+	case X::STRINGTABLE: return "STRINGTABLE";
+	default: return "UNKNOWN";
+	}
+}
+
+static bool read_tail(const unsigned char* data, size_t len, ff_header& out, size_t start_pos, size_t& tail_end)
+{
+	if (start_pos + 3 * 4 > len) return false;
+	size_t pos = start_pos;
+	out.padding = util::read_be32(data, pos); pos += 4;
+	out.size_a = util::read_be32(data, pos); pos += 4;
+	out.size_b = util::read_be32(data, pos); pos += 4;
+	tail_end = pos;
+	return true;
+}
+
+// Address space reserved up front and backed by memory only as it is committed, so the buffer
+// can grow without moving.
+class ReservedBuffer
+{
+public:
+	ReservedBuffer() = default;
+	ReservedBuffer(const ReservedBuffer&) = delete;
+	ReservedBuffer& operator=(const ReservedBuffer&) = delete;
+
+	~ReservedBuffer()
+	{
+		if (!base)
+			return;
+#ifdef _WIN32
+		VirtualFree(base, 0, MEM_RELEASE);
+#else
+		munmap(base, reserved);
+#endif
+	}
+
+	bool reserve(size_t size)
+	{
+#ifdef _WIN32
+		void* p = VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_NOACCESS);
+		if (!p)
+			return false;
+#else
+		void* p = mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (p == MAP_FAILED)
+			return false;
+#endif
+		base = static_cast<unsigned char*>(p);
+		reserved = size;
+		return true;
+	}
+
+	// makes the first upto bytes usable; commits in steps so a growing zone takes few calls
+	bool commit(size_t upto)
+	{
+		if (upto <= committed)
+			return true;
+		if (upto > reserved)
+			return false;
+
+		const size_t step = 4 * 1024 * 1024;
+		size_t end = std::min(reserved, (std::max(upto, committed + step) + step - 1) / step * step);
+#ifdef _WIN32
+		bool ok = VirtualAlloc(base + committed, end - committed, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+#else
+		// mprotect wants a page-aligned start; committed is always a multiple of step or all of reserved
+		bool ok = mprotect(base + committed, end - committed, PROT_READ | PROT_WRITE) == 0;
+#endif
+		if (ok)
+			committed = end;
+		return ok;
+	}
+
+	unsigned char* data() const { return base; }
+
+private:
+	unsigned char* base = nullptr;
+	size_t reserved = 0;
+	size_t committed = 0;
+};
+
+// Inflater stage: fills the zone buffer from the zlib stream on its own thread. ByteSpans over the
+// buffer wait in wait_for() until the bytes they read have been produced. The buffer never moves:
+// max_size bytes are reserved and committed as the stream fills them. The XZoneMemory size is only
+// the first commit, since older linkers always wrote 5000000 there.
+class ZoneInflater : public binary_io::ByteStream
+{
+public:
+	ZoneInflater(const unsigned char* data, size_t len, size_t max_size) : inflater(data, len)
+	{
+		const size_t header_size = 8 + MAX_XFILE_COUNT * 4;
+		unsigned char header[header_size];
+		size_t got = 0;
+		int err = MZ_OK;
+		while (got < header_size && err == MZ_OK)
+		{
+			size_t produced = 0;
+			err = inflater.inflate(header + got, header_size - got, produced);
+			got += produced;
+		}
+
+		// XZoneMemory::size counts everything after the header
+		size_t hint = got == header_size ? header_size + util::read_be32(header, 0) : got;
+		if (!buf.reserve(max_size) || !buf.commit(std::min(std::max<size_t>(hint, 1), max_size)))
+		{
+			logging::error() << "Failed to reserve " << (max_size >> 20) << " MiB for the zone";
+			done = true;
+			return;
+		}
+		capacity = max_size;
+		filled = std::min(got, capacity);
+		std::memcpy(buf.data(), header, filled);
+
+		if (err != MZ_OK)
+		{
+			done = true;
+			complete = err == MZ_STREAM_END;
+		}
+		else
+		{
+			worker = std::thread(&ZoneInflater::run, this);
+		}
+	}
+
+	~ZoneInflater() override
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			cancelled = true;
+		}
+		if (worker.joinable())
+			worker.join();
+	}
+
+	binary_io::ByteSpan zone() const { return binary_io::ByteSpan(buf.data(), capacity, *this); }
+
+	size_t wait_for(size_t want) const override
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		progressed.wait(lock, [&] { return done || filled >= want; });
+		return filled;
+	}
+
+	// waits for the end of the stream; false if it did not inflate cleanly
+	bool succeeded() const
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		progressed.wait(lock, [&] { return done; });
+		return complete;
+	}
+
+private:
+	void run()
+	{
+		const size_t step = 256 * 1024;
+		size_t at = filled;
+		for (;;)
+		{
+			size_t produced = 0;
+			size_t room = std::min(step, capacity - at);
+			int err;
+			if (room > 0)
+			{
+				err = buf.commit(at + room) ? inflater.inflate(buf.data() + at, room, produced) : MZ_MEM_ERROR;
+			}
+			else
+			{
+				// the zone is at max_size; the stream has to end here
+				unsigned char extra;
+				err = inflater.inflate(&extra, 1, produced);
+				if (produced > 0)
+					err = MZ_BUF_ERROR;
+				produced = 0;
+			}
+			at += produced;
+
+			bool stop;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				filled = at;
+				stop = err != MZ_OK || cancelled;
+				if (stop)
+				{
+					done = true;
+					complete = err == MZ_STREAM_END;
+				}
+			}
+			progressed.notify_all();
+
+			if (stop)
+				return;
+		}
+	}
+
+	compression::Inflater inflater;
+	size_t capacity = 0;
+	ReservedBuffer buf;
+
+	mutable std::mutex mutex;
+	mutable std::condition_variable progressed;
+	size_t filled = 0;
+	bool done = false;
+	bool complete = false;
+	bool cancelled = false;
+
+	std::thread worker;
+};
+
+// Writer stage: handlers on the parser thread (and their worker tasks, through take_file()) hand
+// their output here and writer threads apply it to the real sink. Data inside the zone buffer is passed on as a view, anything else is copied.
+// Sinks with concurrent_writes() get several writers and take appends and manifest entries
+// directly, in order; other sinks get a single writer fed in order.
+class QueuedSink : public ExtractSink
+{
+public:
+	QueuedSink(ExtractSink& target, binary_io::ByteSpan zone, unsigned threads)
+		: target(target), zone_begin(zone.data()), zone_end(zone.data() + zone.max_size()),
+		  concurrent(target.concurrent_writes()), ops(64)
+	{
+		unsigned writers = concurrent ? threads : 1;
+		for (unsigned i = 0; i < writers; i++)
+			workers.emplace_back(&QueuedSink::write_worker, this);
+	}
+
+	~QueuedSink() override { finish(); }
+
+	bool begin() override { return true; }
+
+	bool write_file(std::string_view name, binary_io::ByteSpan data) override
+	{
+		return enqueue(WriteOp::Kind::write, name, {}, data);
+	}
+
+	bool take_file(std::string_view name, std::string&& data) override
+	{
+		if (failed)
+			return false;
+
+		WriteOp op;
+		op.name = name;
+		op.owned = std::move(data);
+		return ops.push(std::move(op));
+	}
+
+	bool append_file(std::string_view name, binary_io::ByteSpan data) override
+	{
+		if (concurrent)
+			return !failed && target.append_file(name, data);
+		return enqueue(WriteOp::Kind::append, name, {}, data);
+	}
+
+	bool add_manifest_entry(std::string_view type, std::string_view name) override
+	{
+		if (concurrent)
+			return !failed && target.add_manifest_entry(type, name);
+		return enqueue(WriteOp::Kind::manifest, name, type, {});
+	}
+
+	// waits for every queued write; false if any of them failed
+	bool finish() override
+	{
+		ops.close();
+		for (auto& t : workers)
+			t.join();
+		workers.clear();
+		return !failed;
+	}
+
+private:
+	struct WriteOp
+	{
+		enum class Kind { write, append, manifest } kind = Kind::write;
+		std::string name;
+		std::string type;
+		binary_io::ByteSpan view;
+		std::string owned;
+
+		binary_io::ByteSpan bytes() const { return view.data() ? view : binary_io::as_bytes(owned); }
+	};
+
+	bool enqueue(WriteOp::Kind kind, std::string_view name, std::string_view type, binary_io::ByteSpan data)
+	{
+		if (failed)
+			return false;
+
+		WriteOp op;
+		op.kind = kind;
+		op.name = name;
+		op.type = type;
+		if (data.data() >= zone_begin && data.data() < zone_end)
+			op.view = data;
+		else
+			op.owned.assign(reinterpret_cast<const char*>(data.data()), data.size());
+		return ops.push(std::move(op));
+	}
+
+	void write_worker()
+	{
+		WriteOp op;
+		while (ops.pop(op))
+		{
+			bool ok = true;
+			switch (op.kind)
+			{
+			case WriteOp::Kind::write: ok = target.write_file(op.name, op.bytes()); break;
+			case WriteOp::Kind::append: ok = target.append_file(op.name, op.bytes()); break;
+			case WriteOp::Kind::manifest: ok = target.add_manifest_entry(op.type, op.name); break;
+			}
+			if (!ok)
+				failed = true;
+		}
+	}
+
+	ExtractSink& target;
+	const unsigned char* zone_begin;
+	const unsigned char* zone_end;
+	bool concurrent;
+	BoundedQueue<WriteOp> ops;
+	std::vector<std::thread> workers;
+	std::atomic<bool> failed{false};
+};
+
+namespace fftools
+{
+	Unlinker::Unlinker(const std::string& zone_name, const UnlinkOptions& options)
+		: zone_name(zone_name), options(options)
+	{
+	}
+
+	int Unlinker::unlink(binary_io::ByteSpan ff, ExtractSink& sink)
+	{
+		if (ff.size() < 38)
+		{
+			logging::error() << "File too small";
+			return 1;
+		}
+
+		const unsigned char* data = ff.data();
+
+		ff_header header = {};
+		size_t prefix_end = 0;
+		bool is_mw2 = read_prefix(data, ff.size(), header, prefix_end);
+
+		size_t offset = SIZE_MAX;
+
+		if (is_mw2)
+		{
+			size_t window_start = 0x18;
+			size_t window_end = std::min<size_t>(0x40, ff.size() - 1);
+			for (size_t i = window_start; i + 1 <= window_end; ++i)
+			{
+				if (data[i] == 0x78 && (data[i + 1] == 0x01 || data[i + 1] == 0x9C || data[i + 1] == 0xDA))
+				{
+					offset = i;
+					break;
+				}
+			}
+
+			if (offset == SIZE_MAX)
+			{
+				size_t tail_end = 0;
+				if (read_tail(data, ff.size(), header, prefix_end, tail_end))
+				{
+					offset = find_zlib_header_from(data, ff.size(), tail_end);
+				}
+				else
+				{
+					offset = find_zlib_header(data, ff.size());
+				}
+			}
+		}
+		else
+		{
+			offset = find_zlib_header(data, ff.size());
+		}
+		if (offset == SIZE_MAX)
+		{
+			logging::error() << "No zlib stream found";
+			return 1;
+		}
+
+		const unsigned char* comp_ptr = data + offset;
+		size_t comp_len = ff.size() - offset;
+
+		// inflate, parse and output writes overlap: the handlers below read the zone while it is
+		// still being inflated and hand their files to QueuedSink's writer threads
+		ZoneInflater inflater(comp_ptr, comp_len, MAX_UNLINK_SIZE);
+		binary_io::ByteSpan zone = inflater.zone();
+
+		size_t pos = 0;
+
+		std::uint32_t scriptStringCount = 0;
+		std::uint32_t assetCount = 0;
+		if (!zone.skip(pos, 4 + 4 + (MAX_XFILE_COUNT * 4)) ||
+			!zone.read_be32(pos, scriptStringCount) || !zone.skip(pos, 4) ||
+			!zone.read_be32(pos, assetCount) || !zone.skip(pos, 4))
+		{
+			logging::error() << "Truncated asset list";
+			return 1;
+		}
+
+		if (scriptStringCount > zone.max_size() / 4 || !zone.skip(pos, static_cast<size_t>(scriptStringCount) * 4))
+		{
+			logging::error() << "Malformed script strings";
+			return 1;
+		}
+
+		std::vector<std::string_view> script_strings(scriptStringCount);
+		for (std::uint32_t i = 0; i < scriptStringCount; i++)
+		{
+			if (!zone.read_string(pos, script_strings[i]))
+			{
+				logging::error() << "Malformed script strings";
+				return 1;
+			}
+		}
+
+		if (assetCount > zone.max_size() / 8 || !zone.contains(pos, static_cast<size_t>(assetCount) * 8))
+		{
+			logging::error() << "Truncated asset headers";
+			return 1;
+		}
+
+		auto asset_types = std::make_unique<std::uint32_t[]>(assetCount);
+		auto asset_ptrs = std::make_unique<std::uint32_t[]>(assetCount);
+
+		for (std::uint32_t i = 0; i < assetCount; i++)
+		{
+			if (!zone.read_be32(pos, asset_types[i]) || !zone.read_be32(pos, asset_ptrs[i]))
+			{
+				logging::error() << "Truncated asset headers";
+				return 1;
+			}
+		}
+
+		if (!sink.begin())
+			return 1;
+
+		unsigned threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+		QueuedSink queued(sink, zone, threads);
+		WorkerPool workers(threads);
+		UnlinkContext ctx(zone_name, queued, workers);
+		ctx.verify_hashes = options.verify_hashes;
+		ctx.script_strings = std::move(script_strings);
+		ctx.begin_block(pos);
+
+		for (std::uint32_t i = 0; i < assetCount; i++)
+		{
+			std::uint32_t type = asset_types[i];
+
+			const std::uint32_t PTR_PLACEHOLDER = 0xFFFFFFFFu;
+			if (asset_ptrs[i] == PTR_PLACEHOLDER)
+			{
+			}
+			else if (!zone.contains(asset_ptrs[i], 1))
+			{
+				logging::error() << "Invalid asset ptr for index " << i << ": " << asset_ptrs[i];
+				return 1;
+			}
+			else
+			{
+				pos = asset_ptrs[i];
+			}
+
+			const AssetHandler* handler = find_asset_handler(static_cast<XAssetType>(type));
+			if (!handler || !handler->extract)
+			{
+				logging::info() << "Skipping unknown asset type: " << XAssetTypeToString(type) << " (0x" << logging::hex(type) << ")";
+				continue;
+			}
+
+			if (handler->extract(ctx, zone, pos) < 0)
+				return 1;
+		}
+
+		if (!workers.finish())
+		{
+			logging::error() << "Failed to extract assets";
+			return 1;
+		}
+
+		if (!queued.finish())
+		{
+			logging::error() << "Failed to write output";
+			return 1;
+		}
+
+		if (!inflater.succeeded())
+		{
+			logging::error() << "Decompression failed";
+			return 1;
+		}
+
+		if (!sink.finish())
+		{
+			logging::error() << "Failed to finish writing output";
+			return 1;
+		}
+
+		if (ctx.hash_mismatches > 0)
+		{
+			logging::error() << "Hash verification failed: " << ctx.hash_mismatches << " stringtable cells do not match their stored hash";
+			return 1;
+		}
+
+		return 0;
+	}
+}
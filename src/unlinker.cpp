@@ -1,110 +1,73 @@
-#include <iostream>
 #include <fstream>
-#include <cstring>
-#include <cstdlib>
 #include <vector>
 #include <filesystem>
+#include <cstdlib>
 #include <memory>
-#include <cstdint>
 
-#include "types.hpp"
-#include "util.hpp"
-#include "binary_io.hpp"
-#include "compression.hpp"
-#include "assets.hpp"
+#include "fftools.hpp"
+#include "logging.hpp"
 
 namespace fs = std::filesystem;
 
-struct ff_header
-{
-	std::uint32_t padding = 0;
-	std::uint32_t size_a = 0;
-	std::uint32_t size_b = 0;
-	std::uint32_t region = 0;
-	std::uint32_t bool1 = 0;
-};
-
-static size_t find_zlib_header(const unsigned char* data, size_t len)
+int main(int argc, char** argv)
 {
-	for (size_t i = 0; i + 1 < len; ++i)
+	if (argc < 2)
 	{
-		if (data[i] == 0x78 && (data[i + 1] == 0x01 || data[i + 1] == 0x9C || data[i + 1] == 0xDA))
-			return i;
+		logging::error() << "Usage: " << argv[0] << " [-q|-v|-vv] [-z] [-j <threads>] [--verify] <file.ff|file.ffm> [outdir]    (-q/-v/-vv: less output / one line per asset / everything; -z: write <outdir>.zip instead of loose files; -j: output writer threads; --verify: check stringtable cell hashes)";
+		return 1;
 	}
-	return SIZE_MAX;
-}
+	std::string infile;
+	std::string outdir;
+	bool to_zip = false;
+	fftools::UnlinkOptions options;
 
-static size_t find_zlib_header_from(const unsigned char* data, size_t len, size_t start)
-{
-	if (start >= len) return SIZE_MAX;
-	for (size_t i = start; i + 1 < len; ++i)
+	for (int i = 1; i < argc; ++i)
 	{
-		if (data[i] == 0x78 && (data[i + 1] == 0x01 || data[i + 1] == 0x9C || data[i + 1] == 0xDA))
-			return i;
+		std::string a(argv[i]);
+		if (a == "-z")
+			to_zip = true;
+		else if (a == "-j" && i + 1 < argc)
+			options.threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+		else if (a == "--verify")
+			options.verify_hashes = true;
+		else if (a == "-q")
+			logging::set_level(logging::Level::warning);
+		else if (a == "-v")
+			logging::set_level(logging::Level::verbose);
+		else if (a == "-vv")
+			logging::set_level(logging::Level::debug);
+		else if (!a.empty() && a[0] == '-')
+		{
+			logging::error() << "Unknown option: " << a;
+			return 1;
+		}
+		else if (infile.empty())
+			infile = a;
+		else if (outdir.empty())
+			outdir = a;
+		else
+		{
+			logging::error() << "Unexpected argument: " << a;
+			return 1;
+		}
 	}
-	return SIZE_MAX;
-}
-
-static bool read_prefix(const unsigned char* data, size_t len, ff_header& out, size_t& prefix_end)
-{
-	const unsigned char iw4_magic[] = {'I','W','f','f','u','1','0','0'};
-	if (len < sizeof(iw4_magic)) return false;
-	if (std::memcmp(data, iw4_magic, sizeof(iw4_magic)) != 0) return false;
 
-	(void)out;
-	prefix_end = std::min<size_t>(len, 0x1C);
-	return true;
-}
-
-static const char* XAssetTypeToString(std::uint32_t t)
-{
-	using X = XAssetType;
-	switch (static_cast<X>(t))
+	if (infile.empty())
 	{
-	case X::LOCALIZE_ENTRY: return "LOCALIZE_ENTRY";
-	case X::RAWFILE: return "RAWFILE";
-	case X::STRINGTABLE: return "STRINGTABLE";
-	default: return "UNKNOWN";
+		logging::error() << "Usage: " << argv[0] << " [-q|-v|-vv] [-z] [-j <threads>] [--verify] <file.ff|file.ffm> [outdir]    (-q/-v/-vv: less output / one line per asset / everything; -z: write <outdir>.zip instead of loose files; -j: output writer threads; --verify: check stringtable cell hashes)";
+		return 1;
 	}
-}
-
-bool read_tail(const unsigned char* data, size_t len, ff_header& out, size_t start_pos, size_t& tail_end)
-{
-	if (start_pos + 3 * 4 > len) return false;
-	size_t pos = start_pos;
-	out.padding = util::read_be32(data, pos); pos += 4;
-	out.size_a = util::read_be32(data, pos); pos += 4;
-	out.size_b = util::read_be32(data, pos); pos += 4;
-	tail_end = pos;
-	return true;
-}
 
-size_t get_zlib_offset(const unsigned char* data, size_t len, bool &is_mw2)
-{
-	const unsigned char iw4_magic[] = {'I','W','f','f','u','1','0','0'};
-	if (len >= sizeof(iw4_magic) && std::memcmp(data, iw4_magic, sizeof(iw4_magic)) == 0)
+	if (outdir.empty())
 	{
-		is_mw2 = true;
-		size_t start = 0x18;
-		size_t end = std::min<size_t>(0x40, len - 1);
-		for (size_t i = start; i + 1 <= end; ++i)
-		{
-			if (data[i] == 0x78 && (data[i + 1] == 0x01 || data[i + 1] == 0x9C || data[i + 1] == 0xDA))
-			{
-				return i;
-			}
-		}
-		return find_zlib_header(data, len);
+		fs::path p(infile);
+		outdir = p.stem().string();
 	}
-	is_mw2 = false;
-	return find_zlib_header(data, len);
-}
-int unlink_fastfile(const std::string& infile, const std::string& outdir)
-{
+
 	std::ifstream fin(infile, std::ios::binary);
 	if (!fin.is_open())
 	{
-		std::cerr << "Failed to open input file: " << infile << std::endl;
+		logging::error() << "Failed to open input file: " << infile;
 		return 1;
 	}
 
@@ -112,222 +75,32 @@ int unlink_fastfile(const std::string& infile, const std::string& outdir)
 	size_t flen = fin.tellg();
 	fin.seekg(0, std::ios::beg);
 
-	if (flen < 38)
-	{
-		std::cerr << "File too small" << std::endl;
-		return 1;
-	}
-
-	auto data = std::make_unique<unsigned char[]>(flen);
-	if (!fin.read(reinterpret_cast<char*>(data.get()), flen))
+	std::vector<unsigned char> data(flen);
+	if (!fin.read(reinterpret_cast<char*>(data.data()), flen))
 	{
-		std::cerr << "Failed to read file" << std::endl;
+		logging::error() << "Failed to read file";
 		return 1;
 	}
 	fin.close();
 
-	ff_header header = {};
-	size_t prefix_end = 0;
-	bool is_mw2 = read_prefix(data.get(), flen, header, prefix_end);
+	std::string zone_stem = fs::path(outdir).filename().string();
+	std::string zippath = outdir + ".zip";
 
-	size_t offset = SIZE_MAX;
-	bool tail_read = false;
-
-	if (is_mw2)
-	{
-		size_t window_start = 0x18;
-		size_t window_end = std::min<size_t>(0x40, flen - 1);
-		for (size_t i = window_start; i + 1 <= window_end; ++i)
-		{
-			if (data.get()[i] == 0x78 && (data.get()[i + 1] == 0x01 || data.get()[i + 1] == 0x9C || data.get()[i + 1] == 0xDA))
-			{
-				offset = i;
-				break;
-			}
-		}
-
-		if (offset == SIZE_MAX)
-		{
-			size_t tail_end = 0;
-			if (read_tail(data.get(), flen, header, prefix_end, tail_end))
-			{
-				tail_read = true;
-				offset = find_zlib_header_from(data.get(), flen, tail_end);
-			}
-			else
-			{
-				offset = find_zlib_header(data.get(), flen);
-			}
-		}
-	}
+	std::unique_ptr<ExtractSink> sink;
+	if (to_zip)
+		sink = std::make_unique<ZipSink>(zippath, zone_stem);
 	else
-	{
-		offset = find_zlib_header(data.get(), flen);
-	}
-	if (offset == SIZE_MAX)
-	{
-		std::cerr << "No zlib stream found\n";
-		return 1;
-	}
-
-	const unsigned char* comp_ptr = data.get() + offset;
-	size_t comp_len = flen - offset;
-
-	auto decompressed = compression::decompress_data(comp_ptr, comp_len, static_cast<size_t>(50 * 1024) * 1024);
-	if (decompressed.empty())
-	{
-		std::cerr << "Decompression failed" << std::endl;
-		return 1;
-	}
-
-	auto dest = decompressed.data();
-	size_t dest_len = decompressed.size();
-
-	size_t pos = 0;
-
-	pos += 4 + 4 + (MAX_XFILE_COUNT * 4);
-
-	if (pos + 16 > dest_len)
-	{
-		std::cerr << "Truncated asset list" << std::endl;
-		return 1;
-	}
-
-	std::uint32_t scriptStringCount = util::read_be32(dest, pos);
-	pos += 4;
-	pos += 4;
-	std::uint32_t assetCount = util::read_be32(dest, pos);
-	pos += 4;
-	pos += 4;
+		sink = std::make_unique<FilesystemSink>(outdir);
 
-	pos += scriptStringCount * 4;
+	fftools::Unlinker unlinker(outdir, options);
+	int result = unlinker.unlink(binary_io::ByteSpan(data.data(), data.size()), *sink);
+	if (result != 0)
+		return result;
 
-	for (std::uint32_t i = 0; i < scriptStringCount; i++)
-	{
-		while (pos < dest_len && dest[pos] != '\0')
-			pos++;
-		if (pos >= dest_len)
-		{
-			std::cerr << "Malformed script strings" << std::endl;
-			return 1;
-		}
-		pos++;
-	}
-
-	auto asset_types = std::make_unique<std::uint32_t[]>(assetCount);
-	auto asset_ptrs = std::make_unique<std::uint32_t[]>(assetCount);
-
-	for (std::uint32_t i = 0; i < assetCount; i++)
-	{
-		if (pos + 8 > dest_len)
-		{
-			std::cerr << "Truncated asset headers" << std::endl;
-			return 1;
-		}
-		asset_types[i] = util::read_be32(dest, pos);
-		pos += 4;
-		asset_ptrs[i] = util::read_be32(dest, pos);
-		pos += 4;
-	}
-
-	fs::create_directories(outdir);
-	fs::create_directories(outdir + "/zone_source");
-
-	std::string csvpath = outdir + "/zone_source/" + outdir + ".csv";
-	std::ofstream csvfile(csvpath);
-	if (!csvfile.is_open())
-	{
-		std::cerr << "Failed to create CSV: " << csvpath << std::endl;
-		return 1;
-	}
-
-	for (std::uint32_t i = 0; i < assetCount; i++)
-	{
-		std::uint32_t type = asset_types[i];
-
-		const std::uint32_t PTR_PLACEHOLDER = 0xFFFFFFFFu;
-		if (asset_ptrs[i] == PTR_PLACEHOLDER)
-		{
-		}
-		else if (asset_ptrs[i] >= dest_len)
-		{
-			std::cerr << "Invalid asset ptr for index " << i << ": " << asset_ptrs[i] << std::endl;
-			return 1;
-		}
-		else
-		{
-			pos = asset_ptrs[i];
-		}
-
-		(void)type; (void)asset_ptrs;
-
-		switch (type)
-		{
-			case static_cast<std::uint32_t>(XAssetType::LOCALIZE_ENTRY):
-				if (extract_localize_entry(dest, dest_len, pos, outdir, csvfile) < 0)
-					return -1;
-				break;
-			case static_cast<std::uint32_t>(XAssetType::RAWFILE):
-				if (extract_raw_file(dest, dest_len, pos, outdir, csvfile) < 0)
-					return -1;
-				break;
-			case static_cast<std::uint32_t>(XAssetType::STRINGTABLE):
-				if (extract_string_table(dest, dest_len, pos, outdir, csvfile) < 0)
-					return -1;
-				break;
-			default:
-				std::cout << "Skipping unknown asset type: " << XAssetTypeToString(type) << " (0x" << std::hex << type << std::dec << ")" << std::endl;
-				break;
-		}
-	}
-
-	csvfile.close();
-
-	std::cout << "Extraction complete. Files: " << outdir << "/, CSV: " << csvpath << std::endl;
+	if (to_zip)
+		logging::info() << "Extraction complete. Archive: " << zippath;
+	else
+		logging::info() << "Extraction complete. Files: " << outdir << "/, CSV: " << static_cast<FilesystemSink&>(*sink).manifest_path();
 
-	std::string infile_stem = fs::path(infile).stem().string();
-	std::string out_root = fs::path(outdir).filename().string();
 	return 0;
 }
-
-void init_asset_handlers_impl()
-{
-}
-
-int main(int argc, char** argv)
-{
-	if (argc < 2)
-	{
-		std::cerr << "Usage: " << argv[0] << " <file.ff|file.ffm> [outdir]" << std::endl;
-		return 1;
-	}
-	std::string infile;
-	std::string outdir;
-
-	for (int i = 1; i < argc; ++i)
-	{
-		if (infile.empty())
-			infile = argv[i];
-		else if (outdir.empty())
-			outdir = argv[i];
-		else
-		{
-			std::cerr << "Unexpected argument: " << argv[i] << std::endl;
-			return 1;
-		}
-	}
-
-	if (infile.empty())
-	{
-		std::cerr << "Usage: " << argv[0] << "<file.ff|file.ffm> [outdir]" << std::endl;
-		return 1;
-	}
-
-	if (outdir.empty())
-	{
-		fs::path p(infile);
-		outdir = p.stem().string();
-	}
-
-	return unlink_fastfile(infile, outdir);
-}